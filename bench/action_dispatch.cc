@@ -0,0 +1,68 @@
+// Compares running programmed commands through virtual Action::execute
+// calls with running the same commands lowered to a Program.
+//
+// g++ -Wall -Wextra -O2 -std=c++20 bench/action_dispatch.cc -o action_dispatch
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include "../rover.h"
+
+struct TrueSensor : public Sensor {
+    bool is_safe([[maybe_unused]] coordinate_t x,
+                 [[maybe_unused]] coordinate_t y) override {
+        return true;
+    }
+};
+
+using bench_clock = std::chrono::steady_clock;
+
+double ns_per_command(bench_clock::time_point start, size_t commands) {
+    std::chrono::duration<double, std::nano> elapsed =
+            bench_clock::now() - start;
+    return elapsed.count() / static_cast<double>(commands);
+}
+
+int main() {
+    commands_t commands = {
+        {'F', move_forward()},
+        {'B', move_backward()},
+        {'L', rotate_left()},
+        {'R', rotate_right()},
+        {'U', compose({rotate_right(), rotate_right()})},
+        {'S', compose({move_forward(), rotate_left(), move_forward(),
+                       rotate_right(), compose({move_backward()})})},
+    };
+    sensors_t sensors = {std::make_shared<TrueSensor>(),
+                         std::make_shared<TrueSensor>()};
+
+    std::string command_list;
+    for (int i = 0; i < 100000; ++i)
+        command_list += "FFBRLUSF";
+    constexpr int ROUNDS = 20;
+    size_t total = command_list.size() * ROUNDS;
+
+    Position virtual_position({0, 0}, Direction::NORTH);
+    auto start = bench_clock::now();
+    for (int round = 0; round < ROUNDS; ++round) {
+        for (const auto &command : command_list)
+            commands[command]->execute(virtual_position, sensors);
+    }
+    double virtual_ns = ns_per_command(start, total);
+
+    Program program(commands);
+    Position program_position({0, 0}, Direction::NORTH);
+    start = bench_clock::now();
+    for (int round = 0; round < ROUNDS; ++round) {
+        for (const auto &command : command_list)
+            program.run(command, program_position, sensors);
+    }
+    double program_ns = ns_per_command(start, total);
+
+    std::cout << "virtual: " << virtual_ns << " ns/command, "
+              << virtual_position << "\n"
+              << "program: " << program_ns << " ns/command, "
+              << program_position << "\n";
+    return 0;
+}
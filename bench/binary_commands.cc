@@ -0,0 +1,98 @@
+// Compares command lists sent as text with their binary encoding: size,
+// decoding throughput and the time a rover takes to run each form.
+//
+// g++ -Wall -Wextra -O2 -std=c++20 bench/binary_commands.cc -o binary_commands
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include "../binary_commands.h"
+
+struct TrueSensor : public Sensor {
+    bool is_safe([[maybe_unused]] coordinate_t x,
+                 [[maybe_unused]] coordinate_t y) override {
+        return true;
+    }
+};
+
+using bench_clock = std::chrono::steady_clock;
+
+double elapsed_ns(bench_clock::time_point start) {
+    std::chrono::duration<double, std::nano> elapsed =
+            bench_clock::now() - start;
+    return elapsed.count();
+}
+
+// Runs of one primitive each, of random lengths up to max_run.
+std::string random_runs(size_t length, int max_run, std::mt19937 &random) {
+    const std::string primitives = "FFFBLR";
+    std::string result;
+    while (result.size() < length) {
+        char command = primitives[random() % primitives.size()];
+        result.append(1 + random() % max_run, command);
+    }
+    result.resize(length);
+    return result;
+}
+
+void compare(const std::string &name, const std::string &text,
+             const std::vector<std::string> &tokens) {
+    constexpr int ROUNDS = 10;
+    RoverBuilder builder;
+    builder.program_command('F', move_forward())
+           .program_command('B', move_backward())
+           .program_command('L', rotate_left())
+           .program_command('R', rotate_right())
+           .program_command("F10", repeat(10, move_forward()))
+           .add_sensor(std::make_unique<TrueSensor>());
+    Rover rover = builder.build();
+
+    BinaryCommands encoded = BinaryCommands::encode(text, tokens);
+    std::vector<uint8_t> bytes = encoded.bytes();
+
+    // Decoding is timed on copies made beforehand and moved in, so that
+    // only the parse is measured.
+    std::vector<std::vector<uint8_t>> copies(ROUNDS, bytes);
+    auto start = bench_clock::now();
+    size_t decoded = 0;
+    for (auto &copy : copies)
+        decoded += BinaryCommands(std::move(copy)).bytes().size();
+    double decode_ns = elapsed_ns(start) / ROUNDS;
+    if (decoded != ROUNDS * bytes.size())
+        std::cerr << name << ": decoded " << decoded << " bytes\n";
+
+    rover.land({0, 0}, Direction::NORTH);
+    start = bench_clock::now();
+    for (int round = 0; round < ROUNDS; ++round)
+        rover.execute(text);
+    double text_ns = elapsed_ns(start) / ROUNDS;
+
+    rover.land({0, 0}, Direction::NORTH);
+    start = bench_clock::now();
+    for (int round = 0; round < ROUNDS; ++round)
+        rover.execute(encoded);
+    double binary_ns = elapsed_ns(start) / ROUNDS;
+
+    std::cout << name << ": " << text.size() << " bytes of text, "
+              << bytes.size() << " bytes binary ("
+              << static_cast<double>(text.size()) / bytes.size() << "x), "
+              << "decoding " << bytes.size() / decode_ns * 1e3 << " MB/s, "
+              << "running text " << text_ns / 1e3 << " us, binary "
+              << binary_ns / 1e3 << " us, " << rover << "\n";
+}
+
+int main() {
+    std::mt19937 random(2024);
+    constexpr size_t LENGTH = 1000000;
+    compare("single steps", random_runs(LENGTH, 1, random), {});
+    compare("runs up to 8", random_runs(LENGTH, 8, random), {});
+    compare("runs up to 100", random_runs(LENGTH, 100, random), {});
+
+    std::string tokens;
+    while (tokens.size() < LENGTH)
+        tokens += random() % 2 ? "F10F10R" : "F10LF";
+    compare("tokens", tokens, {"F10"});
+    return 0;
+}
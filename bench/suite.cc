@@ -0,0 +1,255 @@
+// Fixed scenarios covering the main costs of running a rover: turning,
+// moving, composed commands, stopping early, the number of sensors and
+// fleets. Every scenario is seeded, so two runs measure the same work.
+// Results are printed as JSON, one object per scenario, for comparing
+// releases:
+//
+//     {"name": "moves", "ns_per_command": 1.9, "commands": 1000000, ...}
+//
+// ns_per_command is the median over the rounds; for fleets a command is
+// one command run by one rover. timeline_per_span is the time a
+// TimelineObserver adds per span it records, and its commands the spans
+// of a round.
+//
+// g++ -Wall -Wextra -O2 -std=c++20 bench/suite.cc -o suite
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "../fleet.h"
+#include "../timeline.h"
+
+struct TrueSensor : public Sensor {
+    bool is_safe([[maybe_unused]] coordinate_t x,
+                 [[maybe_unused]] coordinate_t y) override {
+        return true;
+    }
+};
+
+// Roughly one field in `period` is dangerous, scattered by a hash.
+struct ScatteredHazards : public Sensor {
+    uint32_t period;
+
+    explicit ScatteredHazards(uint32_t period_) : period(period_) {}
+
+    bool is_safe(coordinate_t x, coordinate_t y) override {
+        uint32_t h = static_cast<uint32_t>(x) * 0x9E3779B1u ^
+                     static_cast<uint32_t>(y) * 0x85EBCA77u;
+        h ^= h >> 15;
+        h *= 0x2C1B3C6Du;
+        h ^= h >> 12;
+        return h % period != 0;
+    }
+};
+
+using bench_clock = std::chrono::steady_clock;
+
+constexpr int ROUNDS = 7;
+
+struct Result {
+    std::string name;
+    double ns_per_command;
+    size_t commands;
+};
+
+std::vector<Result> results;
+
+// Times `round` ROUNDS times; each call runs `commands` commands.
+template <class Round>
+void measure(const std::string &name, size_t commands, Round round) {
+    std::vector<double> times;
+    for (int i = 0; i < ROUNDS; ++i) {
+        auto start = bench_clock::now();
+        round();
+        std::chrono::duration<double, std::nano> elapsed =
+                bench_clock::now() - start;
+        times.push_back(elapsed.count() / static_cast<double>(commands));
+    }
+    std::nth_element(times.begin(), times.begin() + ROUNDS / 2, times.end());
+    results.push_back({name, times[ROUNDS / 2], commands});
+}
+
+std::string random_list(const std::string &alphabet, size_t length,
+                        std::mt19937 &random) {
+    std::string result(length, ' ');
+    for (auto &command : result)
+        command = alphabet[random() % alphabet.size()];
+    return result;
+}
+
+commands_t basic_commands() {
+    return {
+        {'F', move_forward()},
+        {'B', move_backward()},
+        {'L', rotate_left()},
+        {'R', rotate_right()},
+    };
+}
+
+// Runs the whole list on a rover with safe sensors.
+void run_list(const std::string &name, const commands_t &commands,
+              const std::string &list, sensors_t sensors) {
+    Rover rover(commands, std::move(sensors));
+    measure(name, list.size(), [&] {
+        rover.land({0, 0}, Direction::NORTH);
+        rover.execute(list);
+    });
+}
+
+void rotations(std::mt19937 &random) {
+    run_list("rotations", basic_commands(),
+             random_list("LR", 1000000, random),
+             {std::make_shared<TrueSensor>()});
+}
+
+void moves(std::mt19937 &random) {
+    run_list("moves", basic_commands(), random_list("FFFBLR", 1000000, random),
+             {std::make_shared<TrueSensor>()});
+}
+
+commands_t composed_commands() {
+    commands_t commands = basic_commands();
+    commands['U'] = compose({rotate_right(), rotate_right()});
+    commands['S'] = compose({move_forward(), rotate_left(), move_forward(),
+                             rotate_right(), compose({move_backward()})});
+    commands['T'] = compose({commands['S'], commands['U'], commands['S'],
+                             repeat(3, commands['S'])});
+    return commands;
+}
+
+void composed(std::mt19937 &random) {
+    run_list("compose", composed_commands(),
+             random_list("FSTUSL", 200000, random),
+             {std::make_shared<TrueSensor>()});
+}
+
+struct Traced : DefaultRoverPolicy {
+    using observer_type = TimelineObserver;
+};
+
+// The composed list with and without a timeline, and the difference per
+// span recorded.
+void timeline_spans(std::mt19937 &random) {
+    std::string list = random_list("FSTUSL", 200000, random);
+    run_list("timeline_off", composed_commands(), list,
+             {std::make_shared<TrueSensor>()});
+    double off = results.back().ns_per_command;
+    PolicyRover<Traced, sensors_t> rover(composed_commands(),
+                                         {std::make_shared<TrueSensor>()});
+    Timeline timeline;
+    rover.observer().attach(timeline);
+    measure("timeline_on", list.size(), [&] {
+        rover.land({0, 0}, Direction::NORTH);
+        rover.execute(list);
+    });
+    double on = results.back().ns_per_command;
+    uint64_t spans = timeline.size() / ROUNDS;
+    // Nothing to share the difference among when nothing was recorded.
+    if (spans == 0)
+        return;
+    results.push_back({"timeline_per_span",
+                       (on - off) * static_cast<double>(list.size()) /
+                               static_cast<double>(spans),
+                       spans});
+}
+
+// Short lists from random fields among hazards: most lists end early.
+void dangerous_stops(std::mt19937 &random) {
+    constexpr size_t LISTS = 20000, LENGTH = 64;
+    std::vector<std::string> lists;
+    std::vector<Coordinates> landings;
+    for (size_t i = 0; i < LISTS; ++i) {
+        lists.push_back(random_list("FFFFBLR", LENGTH, random));
+        landings.push_back({static_cast<coordinate_t>(random() % 100000),
+                            static_cast<coordinate_t>(random() % 100000)});
+    }
+    Rover rover(basic_commands(), {std::make_shared<ScatteredHazards>(16)});
+    measure("dangerous_stops", LISTS * LENGTH, [&] {
+        for (size_t i = 0; i < LISTS; ++i) {
+            rover.land(landings[i], Direction::NORTH);
+            rover.execute(lists[i]);
+        }
+    });
+}
+
+// Lists with an unknown command somewhere in them.
+void unknown_stops(std::mt19937 &random) {
+    constexpr size_t LISTS = 20000, LENGTH = 64;
+    std::vector<std::string> lists;
+    for (size_t i = 0; i < LISTS; ++i) {
+        lists.push_back(random_list("FFFBLR", LENGTH, random));
+        lists.back()[random() % LENGTH] = 'X';
+    }
+    Rover rover(basic_commands(), {std::make_shared<TrueSensor>()});
+    measure("unknown_stops", LISTS * LENGTH, [&] {
+        for (const auto &list : lists) {
+            rover.land({0, 0}, Direction::NORTH);
+            rover.execute(list);
+        }
+    });
+}
+
+void sensor_scaling(std::mt19937 &random) {
+    std::string list = random_list("FFFBLR", 200000, random);
+    for (int count = 1; count <= 32; count *= 2) {
+        sensors_t sensors;
+        for (int i = 0; i < count; ++i)
+            sensors.push_back(std::make_shared<TrueSensor>());
+        run_list("sensors_" + std::to_string(count), basic_commands(), list,
+                 std::move(sensors));
+    }
+}
+
+template <class T>
+void fleet(const std::string &name, const std::string &alphabet,
+           std::mt19937 &random) {
+    constexpr size_t ROVERS = 4096, LENGTH = 256;
+    std::string list = random_list(alphabet, LENGTH, random);
+    std::vector<Coordinates> landings;
+    for (size_t i = 0; i < ROVERS; ++i) {
+        landings.push_back({static_cast<coordinate_t>(random() % 10000),
+                            static_cast<coordinate_t>(random() % 10000)});
+    }
+    BasicFleet<T> fleet(basic_commands(), {std::make_shared<TrueSensor>()});
+    for (const auto &landing : landings)
+        fleet.land(landing, Direction::NORTH);
+    // Rovers go on from where the last round left them: every field is
+    // safe and no round takes them near the edge of T, so every round
+    // does the same work without landing them again.
+    measure(name, ROVERS * LENGTH, [&] {
+        fleet.execute(list);
+    });
+}
+
+void print_json() {
+    std::cout << "{\n  \"rounds\": " << ROUNDS << ",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result &r = results[i];
+        std::cout << "    {\"name\": \"" << r.name << "\", "
+                  << "\"ns_per_command\": " << r.ns_per_command << ", "
+                  << "\"commands\": " << r.commands << "}"
+                  << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    std::cout << "  ]\n}\n";
+}
+
+int main() {
+    std::mt19937 random(2024);
+    rotations(random);
+    moves(random);
+    composed(random);
+    dangerous_stops(random);
+    unknown_stops(random);
+    sensor_scaling(random);
+    fleet<coordinate_t>("fleet_turns", "LR", random);
+    fleet<coordinate_t>("fleet_moves", "FFFBLR", random);
+    fleet<int16_t>("fleet16_moves", "FFFBLR", random);
+    timeline_spans(random);
+    print_json();
+    return 0;
+}
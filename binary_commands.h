@@ -0,0 +1,214 @@
+#ifndef BINARY_COMMANDS_H
+#define BINARY_COMMANDS_H
+
+#include <bit>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "rover.h"
+
+// An exception that is raised when bytes given as binary commands are
+// not a valid encoding.
+class MalformedCommands : public std::exception {
+public:
+    const char *what() const noexcept override {
+        return "Malformed commands";
+    }
+};
+
+// Binary form of a command list, for storing and sending programs. It is
+// a dictionary of the command tokens used followed by records, each a
+// token and how many times in a row it is run:
+//
+//     token count, then per token: length, bytes
+//     then until the end, per record: (repeat count - 1) << b | token index
+//
+// where b is the number of bits token indices need and a repeat count
+// has to fit in 64 bits. All numbers are LEB128 varints, so a record of
+// a single command usually takes one byte and a run of a thousand 'F'
+// two. The rover runs a record like repeat(count, ...) of the command,
+// without stepping through every repetition when it does not have to.
+class BinaryCommands {
+private:
+    constexpr static uint32_t UNKNOWN = UINT32_MAX;
+
+    std::vector<uint8_t> data;
+    std::vector<std::string> dictionary;
+    // Bits of a record holding the token index.
+    int index_bits = 0;
+    // Offset of the first record.
+    size_t records_begin = 0;
+
+    static int bits_for(uint64_t tokens) {
+        return tokens <= 1 ? 0 : std::bit_width(tokens - 1);
+    }
+
+    static void write_varint(std::vector<uint8_t> &out, uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    // Reads a varint validated by the constructor.
+    uint64_t read_varint(size_t &at) const {
+        uint64_t value = 0;
+        for (int shift = 0;; shift += 7) {
+            uint8_t byte = data[at++];
+            value |= uint64_t{byte & 0x7Fu} << shift;
+            if (byte < 0x80)
+                return value;
+        }
+    }
+
+    uint64_t checked_varint(size_t &at) const {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (at == data.size())
+                throw MalformedCommands();
+            uint8_t byte = data[at++];
+            // The tenth byte only has the top bit of the value left.
+            if (shift == 63 && byte > 1)
+                throw MalformedCommands();
+            value |= uint64_t{byte & 0x7Fu} << shift;
+            if (byte < 0x80)
+                return value;
+        }
+        throw MalformedCommands();
+    }
+
+public:
+    // Decodes bytes, throwing MalformedCommands when they are not valid.
+    explicit BinaryCommands(std::vector<uint8_t> bytes) :
+        data(std::move(bytes)) {
+        size_t at = 0;
+        uint64_t tokens = checked_varint(at);
+        if (tokens > data.size())
+            throw MalformedCommands();
+        dictionary.reserve(tokens);
+        for (uint64_t i = 0; i < tokens; ++i) {
+            uint64_t length = checked_varint(at);
+            if (length == 0 || length > data.size() - at)
+                throw MalformedCommands();
+            dictionary.emplace_back(
+                    reinterpret_cast<const char *>(data.data() + at), length);
+            at += length;
+        }
+        index_bits = bits_for(tokens);
+        records_begin = at;
+        while (at < data.size()) {
+            uint64_t record = checked_varint(at);
+            if (tokens == 0 || (record & index_mask()) >= tokens)
+                throw MalformedCommands();
+            // Its repeat count would wrap around to 0.
+            if (record >> index_bits == UINT64_MAX)
+                throw MalformedCommands();
+        }
+    }
+
+    // Encodes a command list split the way a rover programmed with the
+    // given multi-character tokens splits it: the longest token wins and
+    // any other character is a command of its own.
+    static BinaryCommands encode(std::string_view commands,
+                                 const std::vector<std::string> &tokens = {}) {
+        TokenTrie trie;
+        if (!tokens.empty()) {
+            std::vector<std::pair<std::string, uint32_t>> entries;
+            for (const auto &token : tokens) {
+                if (!token.empty())
+                    entries.emplace_back(token, 0);
+            }
+            trie = TokenTrie(entries);
+        }
+
+        std::map<std::string, uint32_t, std::less<>> index;
+        std::vector<std::string_view> used;
+        std::vector<std::pair<uint32_t, uint64_t>> records;
+        for (size_t i = 0; i < commands.size();) {
+            uint32_t ignored;
+            size_t length = trie.empty() ? 0
+                                         : trie.match(commands, i, ignored);
+            std::string_view token =
+                    commands.substr(i, std::max<size_t>(length, 1));
+            i += token.size();
+            auto it = index.find(token);
+            if (it == index.end()) {
+                it = index.emplace(std::string(token),
+                                   static_cast<uint32_t>(used.size())).first;
+                used.push_back(token);
+            }
+            if (!records.empty() && records.back().first == it->second)
+                ++records.back().second;
+            else
+                records.emplace_back(it->second, 1);
+        }
+
+        std::vector<uint8_t> bytes;
+        write_varint(bytes, used.size());
+        for (std::string_view token : used) {
+            write_varint(bytes, token.size());
+            bytes.insert(bytes.end(), token.begin(), token.end());
+        }
+        int bits = bits_for(used.size());
+        // Longer runs are split over several records.
+        uint64_t max_extra = (UINT64_MAX >> bits) - (bits == 0);
+        for (auto [token, count] : records) {
+            while (count > 0) {
+                uint64_t extra = std::min(count - 1, max_extra);
+                write_varint(bytes, extra << bits | token);
+                count -= extra + 1;
+            }
+        }
+        return BinaryCommands(std::move(bytes));
+    }
+
+    uint64_t index_mask() const {
+        return (uint64_t{1} << index_bits) - 1;
+    }
+
+    const std::vector<uint8_t> &bytes() const {
+        return data;
+    }
+
+    // The command list as text, every repetition written out.
+    std::string text() const {
+        std::string result;
+        size_t at = records_begin;
+        while (at < data.size()) {
+            uint64_t record = read_varint(at);
+            const std::string &token = dictionary[record & index_mask()];
+            result += token;
+            for (uint64_t extra = record >> index_bits; extra > 0; --extra)
+                result += token;
+        }
+        return result;
+    }
+
+    // Runs the records in order. The rover stops at a token its program
+    // does not have as a whole command.
+    template <class Probe>
+    bool run(const Program &program, Position &p, Probe &probe,
+             const sensors_t &sensors) const {
+        std::vector<uint32_t> commands(dictionary.size(), UNKNOWN);
+        for (size_t i = 0; i < dictionary.size(); ++i) {
+            uint32_t command = UNKNOWN;
+            if (program.match(dictionary[i], 0, command) ==
+                    dictionary[i].size())
+                commands[i] = command;
+        }
+        size_t at = records_begin;
+        while (at < data.size()) {
+            uint64_t record = read_varint(at);
+            uint32_t command = commands[record & index_mask()];
+            uint64_t count = (record >> index_bits) + 1;
+            if (command == UNKNOWN ||
+                    !program.run_command(command, p, probe, sensors, count))
+                return false;
+        }
+        return true;
+    }
+};
+
+#endif //BINARY_COMMANDS_H
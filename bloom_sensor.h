@@ -0,0 +1,155 @@
+#ifndef BLOOM_SENSOR_H
+#define BLOOM_SENSOR_H
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+#include "rover.h"
+
+// Wrapper answering "definitely safe" for most cells without asking the
+// wrapped, exact sensor. It keeps a Bloom filter of the dangerous cells;
+// only cells the filter may contain fall through to the exact check.
+// The filter is cache-blocked: all bits of a cell live in one 64-byte
+// block, so a probe touches a single cache line.
+//
+// The list of hazards given at construction must contain every cell
+// the exact sensor reports as dangerous.
+class BloomSensor : public Sensor {
+private:
+    constexpr static int BLOCK_BITS = 512;
+
+    struct alignas(64) Block {
+        uint64_t words[BLOCK_BITS / 64] = {};
+    };
+
+    std::shared_ptr<Sensor> exact;
+    std::vector<Block> blocks;
+    int hashes;
+    size_t hazards;
+
+    uint64_t queries = 0;
+    uint64_t fall_throughs = 0;
+    uint64_t false_positives = 0;
+
+    static uint64_t hash(coordinate_t x, coordinate_t y) {
+        uint64_t h = (uint64_t{static_cast<uint32_t>(x)} << 32) |
+                     static_cast<uint32_t>(y);
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDull;
+        h ^= h >> 33;
+        h *= 0xC4CEB9FE1A85EC53ull;
+        h ^= h >> 33;
+        return h;
+    }
+
+    Block &block(uint64_t h) {
+        // Multiply-shift maps the high half onto [0, blocks.size()).
+        return blocks[((h >> 32) * blocks.size()) >> 32];
+    }
+
+    // Bit positions inside a block come from double hashing on the low half.
+    template <class OnBit>
+    void for_each_bit(uint64_t h, OnBit on_bit) const {
+        uint32_t a = static_cast<uint32_t>(h);
+        uint32_t b = (a >> 16) | (a << 16) | 1;
+        for (int i = 0; i < hashes; ++i) {
+            on_bit(a % BLOCK_BITS);
+            a += b;
+        }
+    }
+
+    bool may_contain(coordinate_t x, coordinate_t y) {
+        uint64_t h = hash(x, y);
+        const Block &b = block(h);
+        bool all = true;
+        for_each_bit(h, [&](uint32_t bit) {
+            all &= (b.words[bit / 64] >> (bit % 64)) & 1;
+        });
+        return all;
+    }
+
+    bool check(coordinate_t x, coordinate_t y) {
+        ++queries;
+        if (!may_contain(x, y))
+            return true;
+        ++fall_throughs;
+        bool safe = exact->is_safe(x, y);
+        false_positives += safe;
+        return safe;
+    }
+
+public:
+    BloomSensor(std::shared_ptr<Sensor> exact_,
+                const std::vector<std::pair<coordinate_t, coordinate_t>> &cells,
+                double bits_per_hazard = 16) :
+        exact(std::move(exact_)), hazards(cells.size()) {
+        bits_per_hazard = std::max(bits_per_hazard, 1.0);
+        auto bits = static_cast<size_t>(
+                std::ceil(bits_per_hazard * std::max<size_t>(hazards, 1)));
+        blocks.resize((bits + BLOCK_BITS - 1) / BLOCK_BITS);
+        hashes = std::clamp(
+                static_cast<int>(std::lround(bits_per_hazard * std::log(2.0))),
+                1, 16);
+        for (const auto &[x, y] : cells) {
+            uint64_t h = hash(x, y);
+            Block &b = block(h);
+            for_each_bit(h, [&](uint32_t bit) {
+                b.words[bit / 64] |= uint64_t{1} << (bit % 64);
+            });
+        }
+    }
+
+    bool is_safe(coordinate_t x, coordinate_t y) override {
+        return check(x, y);
+    }
+
+    uint64_t safe_row(coordinate_t x, coordinate_t y, int width) override {
+        uint64_t mask = 0;
+        for (int i = 0; i < width; ++i)
+            mask |= uint64_t{check(wrapping_add(x, i), y)} << i;
+        return mask;
+    }
+
+    // Cell by cell, without going through the virtual is_safe. The run
+    // ends at the first hazard the exact sensor confirms, so no cell past
+    // it is asked about or counted.
+    coordinate_t safe_run(coordinate_t x, coordinate_t y, Direction d,
+                          coordinate_t limit) override {
+        coordinate_t dx = DirectionManager::get_dx(d);
+        coordinate_t dy = DirectionManager::get_dy(d);
+        limit = std::min({limit, DirectionManager::room(x, dx),
+                          DirectionManager::room(y, dy)});
+        for (coordinate_t k = 0; k < limit; ++k) {
+            x += dx;
+            y += dy;
+            if (!check(x, y))
+                return k;
+        }
+        return limit;
+    }
+
+    // Share of the safe cells asked about so far that had to be checked
+    // by the exact sensor anyway.
+    double false_positive_rate() const {
+        uint64_t safe = queries - (fall_throughs - false_positives);
+        return safe == 0 ? 0.0 : static_cast<double>(false_positives) / safe;
+    }
+
+    // False positive rate predicted for an unblocked filter of the same
+    // size and hash count; blocking makes the actual rate somewhat higher.
+    double expected_false_positive_rate() const {
+        double bits = static_cast<double>(blocks.size()) * BLOCK_BITS;
+        return std::pow(1.0 - std::exp(-hashes * (hazards / bits)), hashes);
+    }
+
+    // Number of queries and how many of them reached the exact sensor.
+    uint64_t query_count() const { return queries; }
+    uint64_t fall_through_count() const { return fall_throughs; }
+
+    size_t memory_bytes() const {
+        return blocks.size() * sizeof(Block);
+    }
+};
+
+#endif //BLOOM_SENSOR_H
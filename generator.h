@@ -0,0 +1,230 @@
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include "rover.h"
+
+// Seeded worlds and command lists for load tests. Everything is integer
+// arithmetic on a seed, with no standard library distributions, so the
+// same seed gives the same scenario on every platform and at any chunk
+// size.
+
+// Probability p as a threshold for 32-bit hashes: a hash is below it
+// with probability p.
+inline uint64_t probability_threshold(double p) {
+    if (!(p > 0))
+        return 0;
+    if (p >= 1)
+        return uint64_t{1} << 32;
+    return static_cast<uint64_t>(std::llround(std::ldexp(p, 32)));
+}
+
+inline uint64_t mix64(uint64_t h) {
+    h ^= h >> 30;
+    h *= 0xBF58476D1CE4E5B9ull;
+    h ^= h >> 27;
+    h *= 0x94D049BB133111EBull;
+    h ^= h >> 31;
+    return h;
+}
+
+// SplitMix64: a tiny generator whose stream is fixed by its seed.
+class SplitMix64 {
+private:
+    uint64_t state;
+public:
+    explicit SplitMix64(uint64_t seed) : state(seed) {}
+
+    uint64_t next() {
+        state += 0x9E3779B97F4A7C15ull;
+        return mix64(state);
+    }
+
+    // Uniform in [0, n), n > 0, by multiply-shift on 32 bits.
+    uint32_t below(uint32_t n) {
+        return static_cast<uint32_t>(((next() >> 32) * n) >> 32);
+    }
+
+    bool chance(uint64_t threshold) {
+        return (next() >> 32) < threshold;
+    }
+};
+
+struct HazardOptions {
+    uint64_t seed = 0;
+    // Share of dangerous fields, before corridors are cleared.
+    double density = 0.05;
+    // Share of fields that follow the verdict of their whole cluster
+    // instead of their own: 0 scatters hazards, 1 makes square blobs.
+    double clustering = 0;
+    // Clusters are squares of 2^cluster_log2 fields, at most 2^16.
+    uint32_t cluster_log2 = 3;
+    // Every corridor_spacing-th row and column is safe; 0 for none.
+    uint32_t corridor_spacing = 0;
+};
+
+// Unbounded hazard map drawn from hashes of the fields, so nothing is
+// stored however large the area a scenario covers.
+class GeneratedHazards : public Sensor {
+private:
+    uint64_t seed;
+    uint64_t density;
+    uint64_t clustering;
+    uint32_t cluster_log2;
+    uint32_t corridor_spacing;
+
+    uint32_t hash(uint32_t x, uint32_t y, uint64_t salt) const {
+        return static_cast<uint32_t>(
+                mix64((uint64_t{x} << 32 | y) ^ mix64(seed + salt)) >> 32);
+    }
+
+    bool in_corridor(coordinate_t c) const {
+        return int64_t{c} % corridor_spacing == 0;
+    }
+
+public:
+    explicit GeneratedHazards(const HazardOptions &options) :
+        seed(options.seed),
+        density(probability_threshold(options.density)),
+        clustering(probability_threshold(options.clustering)),
+        cluster_log2(std::min<uint32_t>(options.cluster_log2, 16)),
+        corridor_spacing(options.corridor_spacing) {}
+
+    bool is_safe(coordinate_t x, coordinate_t y) override {
+        if (corridor_spacing != 0 && (in_corridor(x) || in_corridor(y)))
+            return true;
+        auto ux = static_cast<uint32_t>(x);
+        auto uy = static_cast<uint32_t>(y);
+        // Arithmetic shifts keep the clusters square across zero.
+        auto cx = static_cast<uint32_t>(x >> cluster_log2);
+        auto cy = static_cast<uint32_t>(y >> cluster_log2);
+        bool clustered = hash(ux, uy, 1) < clustering;
+        uint32_t h = clustered ? hash(cx, cy, 2) : hash(ux, uy, 3);
+        return h >= density;
+    }
+};
+
+struct CommandOptions {
+    uint64_t seed = 0;
+    // Share of primitive commands that turn rather than move.
+    double turn_share = 0.25;
+    // Share of commands taken from the composed ones.
+    double compose_share = 0;
+    // Number of levels of composed commands, at most 9.
+    int compose_depth = 0;
+    // Each command picked is written 1 to max_run times in a row.
+    uint32_t max_run = 1;
+    // Share of commands replaced by one that is not programmed.
+    double unknown_share = 0;
+};
+
+// Endless command list with the statistics of CommandOptions, made chunk
+// by chunk. The primitives are 'F', 'B', 'L' and 'R'; composed commands
+// are named '1' to '9' by their nesting level, level k running level
+// k - 1 twice around a primitive, so a level k command expands to about
+// 2^k primitives. 'X' is never programmed.
+class CommandGenerator {
+private:
+    constexpr static char UNKNOWN = 'X';
+    constexpr static char MOVES[] = {'F', 'F', 'F', 'B'};
+    constexpr static char TURNS[] = {'L', 'R'};
+
+    CommandOptions options;
+    SplitMix64 random;
+    uint64_t turn_share;
+    uint64_t compose_share;
+    uint64_t unknown_share;
+    // Rest of the run being written.
+    char current = 'F';
+    uint32_t left = 0;
+
+    char primitive() {
+        if (random.chance(turn_share))
+            return TURNS[random.below(2)];
+        return MOVES[random.below(4)];
+    }
+
+    char pick() {
+        if (random.chance(unknown_share))
+            return UNKNOWN;
+        if (options.compose_depth > 0 && random.chance(compose_share))
+            return static_cast<char>(
+                    '1' + random.below(options.compose_depth));
+        return primitive();
+    }
+
+public:
+    explicit CommandGenerator(const CommandOptions &options_) :
+        options(options_), random(options_.seed),
+        turn_share(probability_threshold(options_.turn_share)),
+        compose_share(probability_threshold(options_.compose_share)),
+        unknown_share(probability_threshold(options_.unknown_share)) {
+        options.compose_depth = std::clamp(options.compose_depth, 0, 9);
+        options.max_run = std::max<uint32_t>(options.max_run, 1);
+    }
+
+    // The commands a rover needs to run the lists, built from the seed
+    // alone.
+    commands_t commands() const {
+        commands_t result = {
+            {'F', move_forward()},
+            {'B', move_backward()},
+            {'L', rotate_left()},
+            {'R', rotate_right()},
+        };
+        SplitMix64 shapes(mix64(options.seed));
+        const char primitives[] = {'F', 'B', 'L', 'R'};
+        command_name_t previous = 'F';
+        for (int level = 1; level <= options.compose_depth; ++level) {
+            auto name = static_cast<command_name_t>('0' + level);
+            result[name] = compose({result[previous],
+                                    result[primitives[shapes.below(4)]],
+                                    result[previous]});
+            previous = name;
+        }
+        return result;
+    }
+
+    // Appends the next length commands to out.
+    void append(std::string &out, size_t length) {
+        out.reserve(out.size() + length);
+        while (length > 0) {
+            if (left == 0) {
+                current = pick();
+                left = 1 + random.below(options.max_run);
+            }
+            size_t n = std::min<size_t>(left, length);
+            out.append(n, current);
+            left -= static_cast<uint32_t>(n);
+            length -= n;
+        }
+    }
+
+    std::string next(size_t length) {
+        std::string chunk;
+        append(chunk, length);
+        return chunk;
+    }
+
+    // Writes the next length commands, chunk_size at a time; a chunk_size
+    // of 0 is taken as 1.
+    void write(std::ostream &out, uint64_t length,
+               size_t chunk_size = 1 << 16) {
+        chunk_size = std::max<size_t>(chunk_size, 1);
+        std::string chunk;
+        while (length > 0) {
+            size_t n = static_cast<size_t>(
+                    std::min<uint64_t>(length, chunk_size));
+            chunk.clear();
+            append(chunk, n);
+            out.write(chunk.data(), static_cast<std::streamsize>(n));
+            length -= n;
+        }
+    }
+};
+
+#endif //GENERATOR_H
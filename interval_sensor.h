@@ -0,0 +1,183 @@
+#ifndef INTERVAL_SENSOR_H
+#define INTERVAL_SENSOR_H
+
+#include <algorithm>
+#include <vector>
+#include "rover.h"
+
+// Horizontal run of dangerous cells (x0, y) .. (x1, y), both ends inclusive.
+struct HazardSpan {
+    coordinate_t y, x0, x1;
+};
+
+// Sensor keeping dangerous spans as sorted, non-overlapping intervals per
+// row. Intervals live in two flat arrays (starts and ends); a directory
+// of the rows having any span points into them. Memory is proportional to
+// the number of spans, not to the area of the map.
+class IntervalSensor : public Sensor {
+private:
+    std::vector<coordinate_t> row_ys;
+    // Intervals of row_ys[r] are [row_begin[r], row_begin[r + 1]).
+    std::vector<uint32_t> row_begin;
+    std::vector<coordinate_t> starts;
+    std::vector<coordinate_t> ends;
+
+    // Number of elements of the sorted range [base, base + n) that are not
+    // greater than value. The loop compiles to conditional moves.
+    static size_t count_not_greater(const coordinate_t *base, size_t n,
+                                    coordinate_t value) {
+        if (n == 0)
+            return 0;
+        const coordinate_t *first = base;
+        while (n > 1) {
+            size_t half = n / 2;
+            base = base[half] <= value ? base + half : base;
+            n -= half;
+        }
+        return static_cast<size_t>(base - first) + (*base <= value);
+    }
+
+    // Index of row y in the directory, or -1 when it has no spans.
+    ptrdiff_t find_row(coordinate_t y) const {
+        auto it = std::lower_bound(row_ys.begin(), row_ys.end(), y);
+        if (it == row_ys.end() || *it != y)
+            return -1;
+        return it - row_ys.begin();
+    }
+
+    // Index of the last interval of row r starting at or before x, or -1.
+    ptrdiff_t last_starting_by(ptrdiff_t r, coordinate_t x) const {
+        uint32_t begin = row_begin[r];
+        size_t n = row_begin[r + 1] - begin;
+        return static_cast<ptrdiff_t>(begin) - 1 +
+               static_cast<ptrdiff_t>(
+                       count_not_greater(starts.data() + begin, n, x));
+    }
+
+    bool row_contains(ptrdiff_t r, coordinate_t x) const {
+        ptrdiff_t i = last_starting_by(r, x);
+        return i >= row_begin[r] && ends[i] >= x;
+    }
+
+    // Clears in mask the bits of the cells of row r dangerous among
+    // (x + i, y) for 0 <= i < width, bit shift + i standing for each.
+    // The cells must not run past INT32_MAX.
+    void clear_spans(ptrdiff_t r, coordinate_t x, int width, int shift,
+                     uint64_t &mask) const {
+        int64_t last = int64_t{x} + width - 1;
+        ptrdiff_t i = std::max<ptrdiff_t>(last_starting_by(r, x), row_begin[r]);
+        for (; i < row_begin[r + 1] && starts[i] <= last; ++i) {
+            int64_t from = std::max<int64_t>(starts[i], x) - x + shift;
+            int64_t to = std::min<int64_t>(ends[i], last) - x + shift;
+            if (from > to)
+                continue;
+            uint64_t bits = to - from == 63 ? ~uint64_t{0}
+                    : ((uint64_t{1} << (to - from + 1)) - 1) << from;
+            mask &= ~bits;
+        }
+    }
+
+public:
+    IntervalSensor(std::vector<HazardSpan> spans) {
+        for (auto &span : spans) {
+            if (span.x0 > span.x1)
+                std::swap(span.x0, span.x1);
+        }
+        std::sort(spans.begin(), spans.end(),
+                  [](const HazardSpan &a, const HazardSpan &b) {
+            return a.y != b.y ? a.y < b.y : a.x0 < b.x0;
+        });
+        for (const auto &span : spans) {
+            bool same_row = !row_ys.empty() && row_ys.back() == span.y;
+            // Overlapping or touching spans of a row are merged.
+            if (same_row && int64_t{span.x0} <= int64_t{ends.back()} + 1) {
+                ends.back() = std::max(ends.back(), span.x1);
+                continue;
+            }
+            if (!same_row) {
+                row_ys.push_back(span.y);
+                row_begin.push_back(static_cast<uint32_t>(starts.size()));
+            }
+            starts.push_back(span.x0);
+            ends.push_back(span.x1);
+        }
+        row_begin.push_back(static_cast<uint32_t>(starts.size()));
+    }
+
+    bool is_safe(coordinate_t x, coordinate_t y) override {
+        ptrdiff_t r = find_row(y);
+        return r < 0 || !row_contains(r, x);
+    }
+
+    uint64_t safe_row(coordinate_t x, coordinate_t y, int width) override {
+        uint64_t mask = width == 64 ? ~uint64_t{0}
+                                    : (uint64_t{1} << width) - 1;
+        ptrdiff_t r = find_row(y);
+        if (r < 0)
+            return mask;
+        // Cells up to INT32_MAX, then those wrapping around to INT32_MIN.
+        int before_edge = static_cast<int>(
+                std::min<int64_t>(width, int64_t{INT32_MAX} - x + 1));
+        clear_spans(r, x, before_edge, 0, mask);
+        if (before_edge < width)
+            clear_spans(r, INT32_MIN, width - before_edge, before_edge, mask);
+        return mask;
+    }
+
+    coordinate_t safe_run(coordinate_t x, coordinate_t y, Direction d,
+                          coordinate_t limit) override {
+        coordinate_t dx = DirectionManager::get_dx(d);
+        coordinate_t dy = DirectionManager::get_dy(d);
+        limit = std::min({limit, DirectionManager::room(x, dx),
+                          DirectionManager::room(y, dy)});
+        if (limit <= 0)
+            return 0;
+
+        if (dy == 0) {
+            // Along a row: one search finds the nearest span ahead.
+            ptrdiff_t r = find_row(y);
+            if (r < 0)
+                return limit;
+            coordinate_t next = x + dx;
+            ptrdiff_t i = last_starting_by(r, next);
+            bool before_any = i < row_begin[r];
+            if (!before_any && ends[i] >= next)
+                return 0;
+            int64_t free;
+            if (dx > 0) {
+                bool after_all = i + 1 >= row_begin[r + 1];
+                free = after_all ? limit : int64_t{starts[i + 1]} - next;
+            }
+            else {
+                free = before_any ? limit : int64_t{next} - ends[i];
+            }
+            return static_cast<coordinate_t>(std::min<int64_t>(free, limit));
+        }
+
+        // Across rows: only rows having spans need to be looked at.
+        if (dy > 0) {
+            auto it = std::upper_bound(row_ys.begin(), row_ys.end(), y);
+            for (; it != row_ys.end() && int64_t{*it} - y <= limit; ++it) {
+                if (row_contains(it - row_ys.begin(), x))
+                    return static_cast<coordinate_t>(int64_t{*it} - y - 1);
+            }
+        }
+        else {
+            auto it = std::lower_bound(row_ys.begin(), row_ys.end(), y);
+            while (it != row_ys.begin() && int64_t{y} - *(it - 1) <= limit) {
+                --it;
+                if (row_contains(it - row_ys.begin(), x))
+                    return static_cast<coordinate_t>(int64_t{y} - *it - 1);
+            }
+        }
+        return limit;
+    }
+
+    size_t memory_bytes() const {
+        return row_ys.size() * sizeof(coordinate_t) +
+               row_begin.size() * sizeof(uint32_t) +
+               (starts.size() + ends.size()) * sizeof(coordinate_t);
+    }
+};
+
+#endif //INTERVAL_SENSOR_H
@@ -0,0 +1,311 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "rover.h"
+#include "thread_shards.h"
+
+// Log-linear bucketing of latencies in nanoseconds, as in HDR
+// histograms: values below 2^SUB_BITS have a bucket each, and every
+// further power of two is split into 2^(SUB_BITS - 1) buckets, so a
+// bucket is never wider than about 3% of its values. Values from 2^40 ns
+// (some 18 minutes) on share the last bucket.
+class LatencyBuckets {
+public:
+    constexpr static int SUB_BITS = 6;
+    constexpr static int MAX_BITS = 40;
+    constexpr static uint64_t HALF = uint64_t{1} << (SUB_BITS - 1);
+    constexpr static size_t COUNT = (MAX_BITS - SUB_BITS + 2) * HALF;
+
+    static size_t bucket(uint64_t ns) {
+        ns = std::min(ns, (uint64_t{1} << MAX_BITS) - 1);
+        int shift = std::max(static_cast<int>(std::bit_width(ns)) - SUB_BITS, 0);
+        return static_cast<size_t>(shift * HALF + (ns >> shift));
+    }
+
+    static uint64_t lowest(size_t b) {
+        if (b < 2 * HALF)
+            return b;
+        uint64_t shift = b / HALF - 1;
+        return (b - shift * HALF) << shift;
+    }
+
+    static uint64_t highest(size_t b) {
+        return b + 1 == COUNT ? UINT64_MAX : lowest(b + 1) - 1;
+    }
+};
+
+// Histogram written by one thread and read by any. Updates are relaxed
+// loads and stores, without locked instructions; readers may see a
+// sample in the counts but not yet in the sum.
+class HistogramShard {
+private:
+    std::array<std::atomic<uint64_t>, LatencyBuckets::COUNT> counts = {};
+    std::atomic<uint64_t> sum = 0;
+    std::atomic<uint64_t> longest = 0;
+
+    static void bump(std::atomic<uint64_t> &a, uint64_t by) {
+        a.store(a.load(std::memory_order_relaxed) + by,
+                std::memory_order_relaxed);
+    }
+
+    friend class HistogramSnapshot;
+
+public:
+    void record(uint64_t ns) {
+        bump(counts[LatencyBuckets::bucket(ns)], 1);
+        bump(sum, ns);
+        if (ns > longest.load(std::memory_order_relaxed))
+            longest.store(ns, std::memory_order_relaxed);
+    }
+};
+
+// Counts merged from any number of shards.
+class HistogramSnapshot {
+private:
+    std::vector<uint64_t> counts =
+            std::vector<uint64_t>(LatencyBuckets::COUNT);
+    uint64_t samples = 0;
+    uint64_t sum = 0;
+    uint64_t longest = 0;
+
+public:
+    void add(const HistogramShard &shard) {
+        for (size_t b = 0; b < LatencyBuckets::COUNT; ++b) {
+            uint64_t n = shard.counts[b].load(std::memory_order_relaxed);
+            counts[b] += n;
+            samples += n;
+        }
+        sum += shard.sum.load(std::memory_order_relaxed);
+        longest = std::max(longest,
+                           shard.longest.load(std::memory_order_relaxed));
+    }
+
+    void add(const HistogramSnapshot &other) {
+        for (size_t b = 0; b < LatencyBuckets::COUNT; ++b)
+            counts[b] += other.counts[b];
+        samples += other.samples;
+        sum += other.sum;
+        longest = std::max(longest, other.longest);
+    }
+
+    uint64_t count() const { return samples; }
+    uint64_t max_ns() const { return longest; }
+
+    double mean_ns() const {
+        return samples == 0 ? 0.0 : static_cast<double>(sum) / samples;
+    }
+
+    // Upper bound of the bucket holding the q-quantile, 0 <= q <= 1;
+    // never above the largest sample.
+    uint64_t percentile_ns(double q) const {
+        if (samples == 0)
+            return 0;
+        auto rank = static_cast<uint64_t>(
+                std::max(1.0, std::ceil(q * static_cast<double>(samples))));
+        uint64_t seen = 0;
+        for (size_t b = 0; b < LatencyBuckets::COUNT; ++b) {
+            seen += counts[b];
+            if (seen >= rank)
+                return std::min(LatencyBuckets::highest(b), longest);
+        }
+        return longest;
+    }
+
+    // Non-empty buckets as (lowest value, count), for exporting.
+    std::vector<std::pair<uint64_t, uint64_t>> buckets() const {
+        std::vector<std::pair<uint64_t, uint64_t>> result;
+        for (size_t b = 0; b < LatencyBuckets::COUNT; ++b) {
+            if (counts[b] != 0)
+                result.emplace_back(LatencyBuckets::lowest(b), counts[b]);
+        }
+        return result;
+    }
+};
+
+// All histograms of a recorder at one point in time.
+struct LatencySnapshot {
+    HistogramSnapshot execute;
+    // By command token, in the order of the commands given.
+    std::vector<std::pair<std::string, HistogramSnapshot>> commands;
+    // By sensor index.
+    std::vector<HistogramSnapshot> sensors;
+};
+
+// Latency histograms of execute, of each programmed command and of each
+// sensor, shared by rovers on any number of threads. Each thread writes
+// only to its own shard, found through a thread_local cache, so
+// recording takes no locks; snapshot() merges the shards.
+class LatencyRecorder {
+public:
+    struct Shard {
+        HistogramShard execute;
+        std::vector<HistogramShard> commands;
+        std::vector<HistogramShard> sensors;
+
+        Shard(size_t commands, size_t sensors) :
+            commands(commands), sensors(sensors) {}
+    };
+
+    constexpr static uint32_t UNKNOWN = UINT32_MAX;
+
+private:
+    std::vector<std::string> names;
+    std::array<uint32_t, 256> by_char;
+    std::map<std::string, uint32_t, std::less<>> by_token;
+    size_t sensor_count;
+    ThreadShards<Shard> shards;
+
+public:
+    LatencyRecorder(const commands_t &commands, size_t sensors,
+                    const command_tokens_t &command_tokens = {}) :
+        sensor_count(sensors) {
+        by_char.fill(UNKNOWN);
+        for (const auto &[name, action] : commands) {
+            by_char[static_cast<unsigned char>(name)] =
+                    static_cast<uint32_t>(names.size());
+            names.emplace_back(1, name);
+        }
+        for (const auto &[token, action] : command_tokens) {
+            by_token.emplace(token, static_cast<uint32_t>(names.size()));
+            names.push_back(token);
+        }
+    }
+
+    LatencyRecorder(const LatencyRecorder &) = delete;
+    LatencyRecorder &operator=(const LatencyRecorder &) = delete;
+
+    uint32_t command_index(std::string_view command) const {
+        if (command.size() == 1)
+            return by_char[static_cast<unsigned char>(command[0])];
+        auto it = by_token.find(command);
+        return it == by_token.end() ? UNKNOWN : it->second;
+    }
+
+    size_t sensors() const {
+        return sensor_count;
+    }
+
+    // The calling thread's shard, made on first use.
+    Shard &shard() {
+        return shards.local([&] {
+            return std::make_unique<Shard>(names.size(), sensor_count);
+        });
+    }
+
+    LatencySnapshot snapshot() const {
+        LatencySnapshot result;
+        result.commands.resize(names.size());
+        for (size_t i = 0; i < names.size(); ++i)
+            result.commands[i].first = names[i];
+        result.sensors.resize(sensor_count);
+        shards.for_each([&](const Shard &shard) {
+            result.execute.add(shard.execute);
+            for (size_t i = 0; i < names.size(); ++i)
+                result.commands[i].second.add(shard.commands[i]);
+            for (size_t i = 0; i < sensor_count; ++i)
+                result.sensors[i].add(shard.sensors[i]);
+        });
+        return result;
+    }
+};
+
+// Observer feeding a LatencyRecorder. A command's latency runs from its
+// dispatch to the next one or to the end of execute, sensors included;
+// commands only run through text lists. Rovers start without a recorder
+// and record nothing until attached to one:
+//
+//     struct Timed : DefaultRoverPolicy {
+//         using observer_type = LatencyObserver;
+//     };
+//     LatencyRecorder recorder(commands, sensors.size());
+//     rover.observer().attach(recorder);
+class LatencyObserver : public NullObserver {
+private:
+    using clock = std::chrono::steady_clock;
+
+    LatencyRecorder *recorder = nullptr;
+    LatencyRecorder::Shard *shard = nullptr;
+    clock::time_point execute_start, command_start, probe_start;
+    uint32_t command = LatencyRecorder::UNKNOWN;
+
+    static uint64_t since(clock::time_point start, clock::time_point now) {
+        return static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        now - start).count());
+    }
+
+    void end_command(clock::time_point now) {
+        if (command != LatencyRecorder::UNKNOWN)
+            shard->commands[command].record(since(command_start, now));
+        command = LatencyRecorder::UNKNOWN;
+    }
+
+    void end_probe(size_t sensor) {
+        if (shard != nullptr && sensor < shard->sensors.size())
+            shard->sensors[sensor].record(since(probe_start, clock::now()));
+    }
+
+public:
+    constexpr static bool enabled = true;
+
+    void attach(LatencyRecorder &r) {
+        recorder = &r;
+    }
+
+    void on_execute_begin([[maybe_unused]] const Position &p) {
+        // The rover may run on another thread than the last time.
+        shard = recorder == nullptr ? nullptr : &recorder->shard();
+        command = LatencyRecorder::UNKNOWN;
+        execute_start = clock::now();
+    }
+
+    void on_dispatch(std::string_view name) {
+        if (shard == nullptr)
+            return;
+        clock::time_point now = clock::now();
+        end_command(now);
+        command = recorder->command_index(name);
+        command_start = now;
+    }
+
+    void on_probe_begin([[maybe_unused]] size_t sensor) {
+        if (shard != nullptr)
+            probe_start = clock::now();
+    }
+
+    void on_probe(size_t sensor, [[maybe_unused]] coordinate_t x,
+                  [[maybe_unused]] coordinate_t y,
+                  [[maybe_unused]] bool safe) {
+        end_probe(sensor);
+    }
+
+    void on_run(size_t sensor, [[maybe_unused]] coordinate_t x,
+                [[maybe_unused]] coordinate_t y,
+                [[maybe_unused]] Direction d,
+                [[maybe_unused]] coordinate_t limit,
+                [[maybe_unused]] coordinate_t free) {
+        end_probe(sensor);
+    }
+
+    void on_execute_end([[maybe_unused]] const Position &p,
+                        [[maybe_unused]] StopReason reason) {
+        if (shard == nullptr)
+            return;
+        clock::time_point now = clock::now();
+        end_command(now);
+        shard->execute.record(since(execute_start, now));
+    }
+};
+
+#endif //LATENCY_H
@@ -0,0 +1,153 @@
+#ifndef NOISE_SENSOR_H
+#define NOISE_SENSOR_H
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include "rover.h"
+
+// Procedural terrain: a cell is dangerous where seeded value noise drops
+// below a threshold. Nothing is stored, so the world is unbounded, and
+// everything is integer arithmetic, so the same seed gives the same map
+// on every platform.
+//
+// Noise values are 8-bit, drawn from a hash of the corners of a lattice
+// with cells of 2^scale_log2 map cells and interpolated bilinearly.
+class NoiseSensor : public Sensor {
+private:
+    constexpr static int LANES = 64;
+    constexpr static uint32_t MAX_SIZE = 256;
+
+    uint32_t seed;
+    uint32_t scale_log2;
+    uint32_t threshold;
+
+    static uint64_t reverse_bits(uint64_t v) {
+        v = ((v >> 1) & 0x5555555555555555ull) | ((v & 0x5555555555555555ull) << 1);
+        v = ((v >> 2) & 0x3333333333333333ull) | ((v & 0x3333333333333333ull) << 2);
+        v = ((v >> 4) & 0x0F0F0F0F0F0F0F0Full) | ((v & 0x0F0F0F0F0F0F0F0Full) << 4);
+        v = ((v >> 8) & 0x00FF00FF00FF00FFull) | ((v & 0x00FF00FF00FF00FFull) << 8);
+        v = ((v >> 16) & 0x0000FFFF0000FFFFull) | ((v & 0x0000FFFF0000FFFFull) << 16);
+        return (v >> 32) | (v << 32);
+    }
+
+    static uint32_t lattice(uint32_t ix, uint32_t iy, uint32_t seed) {
+        uint32_t h = ix * 0x9E3779B1u ^ iy * 0x85EBCA77u ^ seed;
+        h ^= h >> 15;
+        h *= 0x2C1B3C6Du;
+        h ^= h >> 12;
+        h *= 0x297A2D39u;
+        h ^= h >> 15;
+        return h >> 24;
+    }
+
+    uint32_t value(coordinate_t x, coordinate_t y) const {
+        uint32_t size = uint32_t{1} << scale_log2;
+        uint32_t ix = static_cast<uint32_t>(x >> scale_log2);
+        uint32_t iy = static_cast<uint32_t>(y >> scale_log2);
+        uint32_t fx = static_cast<uint32_t>(x) & (size - 1);
+        uint32_t fy = static_cast<uint32_t>(y) & (size - 1);
+        uint32_t bottom = lattice(ix, iy, seed) * (size - fx) +
+                          lattice(ix + 1, iy, seed) * fx;
+        uint32_t top = lattice(ix, iy + 1, seed) * (size - fx) +
+                       lattice(ix + 1, iy + 1, seed) * fx;
+        return (bottom * (size - fy) + top * fy) >> (2 * scale_log2);
+    }
+
+    // Safety of the LANES cells starting at (x, y) going east. Lattice
+    // hashes are shared by all cells of a lattice column, so they are
+    // computed once per column and interpolated along y; each lattice cell
+    // is then blended along x by a loop with no branches and no gathers,
+    // which the compiler vectorizes (at -O3 with GCC).
+    uint64_t row_mask(coordinate_t x, coordinate_t y) const {
+        uint32_t size = uint32_t{1} << scale_log2;
+        if (x > INT32_MAX - LANES - static_cast<coordinate_t>(size)) {
+            // Cells past the end of the range wrap around.
+            uint64_t mask = 0;
+            for (int i = 0; i < LANES; ++i) {
+                coordinate_t cx = static_cast<coordinate_t>(
+                        static_cast<uint32_t>(x) + static_cast<uint32_t>(i));
+                mask |= uint64_t{value(cx, y) >= threshold} << i;
+            }
+            return mask;
+        }
+        uint32_t iy = static_cast<uint32_t>(y >> scale_log2);
+        uint32_t fy = static_cast<uint32_t>(y) & (size - 1);
+        uint32_t ix0 = static_cast<uint32_t>(x >> scale_log2);
+        uint32_t offset = static_cast<uint32_t>(x) & (size - 1);
+        uint32_t columns = (offset + LANES + size - 1) >> scale_log2;
+
+        // Cells from the start of the first lattice cell on.
+        alignas(8) uint8_t safe[LANES + 2 * MAX_SIZE];
+        uint32_t left = lattice(ix0, iy, seed) * (size - fy) +
+                        lattice(ix0, iy + 1, seed) * fy;
+        for (uint32_t k = 0; k < columns; ++k) {
+            uint32_t ix = ix0 + k + 1;
+            uint32_t right = lattice(ix, iy, seed) * (size - fy) +
+                             lattice(ix, iy + 1, seed) * fy;
+            uint8_t *cells = safe + (k << scale_log2);
+            for (uint32_t fx = 0; fx < size; ++fx) {
+                uint32_t v = (left * (size - fx) + right * fx) >>
+                             (2 * scale_log2);
+                cells[fx] = v >= threshold;
+            }
+            left = right;
+        }
+
+        uint64_t mask = 0;
+        for (int i = 0; i < LANES; i += 8) {
+            if constexpr (std::endian::native == std::endian::little) {
+                // Eight 0/1 bytes gathered into eight bits at once.
+                uint64_t bytes;
+                std::memcpy(&bytes, safe + offset + i, sizeof(bytes));
+                mask |= ((bytes * 0x0102040810204080ull) >> 56) << i;
+            }
+            else {
+                for (int j = 0; j < 8; ++j)
+                    mask |= uint64_t{safe[offset + i + j]} << (i + j);
+            }
+        }
+        return mask;
+    }
+
+public:
+    // threshold is out of 256: roughly that fraction of cells is dangerous.
+    // scale_log2 may be at most 8.
+    NoiseSensor(uint32_t seed_, uint32_t scale_log2_, uint32_t threshold_) :
+        seed(seed_), scale_log2(std::min<uint32_t>(scale_log2_, 8)),
+        threshold(threshold_) {}
+
+    bool is_safe(coordinate_t x, coordinate_t y) override {
+        return value(x, y) >= threshold;
+    }
+
+    uint64_t safe_row(coordinate_t x, coordinate_t y, int width) override {
+        uint64_t mask = row_mask(x, y);
+        return width == 64 ? mask : mask & ((uint64_t{1} << width) - 1);
+    }
+
+    coordinate_t safe_run(coordinate_t x, coordinate_t y, Direction d,
+                          coordinate_t limit) override {
+        if (d == Direction::NORTH || d == Direction::SOUTH)
+            return Sensor::safe_run(x, y, d, limit);
+        coordinate_t dx = DirectionManager::get_dx(d);
+        limit = std::min(limit, DirectionManager::room(x, dx));
+
+        // Whole blocks of LANES cells, the first one starting next to x.
+        coordinate_t done = 0;
+        while (done < limit) {
+            int64_t next = int64_t{x} + int64_t{dx} * (int64_t{done} + 1);
+            int64_t start = dx > 0 ? next : next - (LANES - 1);
+            uint64_t safe = row_mask(static_cast<coordinate_t>(start), y);
+            // Bit i of run tells about the i-th cell along the heading.
+            uint64_t run = dx > 0 ? safe : reverse_bits(safe);
+            int free = std::countr_one(run);
+            if (free < LANES || limit - done <= LANES)
+                return std::min<coordinate_t>(limit, done + free);
+            done += LANES;
+        }
+        return limit;
+    }
+};
+
+#endif //NOISE_SENSOR_H
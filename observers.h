@@ -0,0 +1,250 @@
+#ifndef OBSERVERS_H
+#define OBSERVERS_H
+
+#include <array>
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "rover.h"
+
+// Observers for rover policies. Each one is picked at compile time:
+//
+//     struct Counted : DefaultRoverPolicy {
+//         using observer_type = CountingObserver;
+//     };
+//     PolicyRover<Counted, sensors_t> rover(commands, sensors);
+//     ...
+//     rover.observer().commands;
+//
+// They derive from NullObserver, so hooks they do not need cost nothing.
+
+// Counts of everything a rover did.
+class CountingObserver : public NullObserver {
+public:
+    constexpr static bool enabled = true;
+
+    uint64_t lands = 0;
+    uint64_t executes = 0;
+    uint64_t commands = 0;
+    // Fields asked about one by one, and how many of them were dangerous.
+    uint64_t probes = 0;
+    uint64_t unsafe_probes = 0;
+    // Segment queries and the fields they covered.
+    uint64_t runs = 0;
+    uint64_t run_fields = 0;
+    // Questions asked to each sensor, by index.
+    std::vector<uint64_t> sensor_queries;
+    // Stops by StopReason.
+    std::array<uint64_t, 4> stops = {};
+
+    void on_land([[maybe_unused]] const Position &p) {
+        ++lands;
+    }
+
+    void on_execute_begin([[maybe_unused]] const Position &p) {
+        ++executes;
+    }
+
+    void on_dispatch([[maybe_unused]] std::string_view command) {
+        ++commands;
+    }
+
+    void on_probe(size_t sensor, [[maybe_unused]] coordinate_t x,
+                  [[maybe_unused]] coordinate_t y, bool safe) {
+        ++probes;
+        unsafe_probes += !safe;
+        query(sensor);
+    }
+
+    void on_run(size_t sensor, [[maybe_unused]] coordinate_t x,
+                [[maybe_unused]] coordinate_t y,
+                [[maybe_unused]] Direction d,
+                [[maybe_unused]] coordinate_t limit, coordinate_t free) {
+        ++runs;
+        run_fields += static_cast<uint64_t>(free);
+        query(sensor);
+    }
+
+    void on_stop([[maybe_unused]] const Position &p, StopReason reason) {
+        ++stops[static_cast<size_t>(reason)];
+    }
+
+private:
+    void query(size_t sensor) {
+        if (sensor >= sensor_queries.size())
+            sensor_queries.resize(sensor + 1);
+        ++sensor_queries[sensor];
+    }
+};
+
+// Wall time of one execute in 2^period_log2, so that timing costs little
+// on average. The latest capacity samples are kept.
+template <unsigned period_log2 = 6, size_t capacity = 4096>
+class SampledLatencyObserver : public NullObserver {
+private:
+    using clock = std::chrono::steady_clock;
+
+    uint64_t executes = 0;
+    bool sampling = false;
+    clock::time_point start;
+    std::vector<uint64_t> latest;
+    uint64_t sampled = 0;
+    uint64_t total_ns = 0;
+    uint64_t longest_ns = 0;
+
+public:
+    void on_execute_begin([[maybe_unused]] const Position &p) {
+        sampling = (executes++ & ((uint64_t{1} << period_log2) - 1)) == 0;
+        if (sampling)
+            start = clock::now();
+    }
+
+    void on_execute_end([[maybe_unused]] const Position &p,
+                        [[maybe_unused]] StopReason reason) {
+        if (!sampling)
+            return;
+        auto ns = static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        clock::now() - start).count());
+        if (latest.size() < capacity)
+            latest.push_back(ns);
+        else
+            latest[sampled % capacity] = ns;
+        ++sampled;
+        total_ns += ns;
+        longest_ns = std::max(longest_ns, ns);
+    }
+
+    uint64_t sample_count() const { return sampled; }
+    uint64_t max_ns() const { return longest_ns; }
+
+    double mean_ns() const {
+        return sampled == 0 ? 0.0 : static_cast<double>(total_ns) / sampled;
+    }
+
+    // The latest samples, in no particular order.
+    const std::vector<uint64_t> &samples() const {
+        return latest;
+    }
+};
+
+// Something a rover did, as recorded by TraceObserver.
+struct TraceEvent {
+    enum class Kind : uint8_t {
+        LAND,
+        EXECUTE_BEGIN,
+        DISPATCH,
+        PROBE,
+        RUN,
+        STOP,
+        EXECUTE_END
+    };
+
+    Kind kind;
+    // Index of the sensor asked, for PROBE and RUN.
+    uint32_t sensor = 0;
+    // The field asked about, or where the rover is.
+    coordinate_t x = 0, y = 0;
+    // Whether the field is safe for PROBE, the safe fields of the run for
+    // RUN, the direction for LAND and EXECUTE_*, the StopReason for STOP.
+    int64_t value = 0;
+    // Command token for DISPATCH.
+    std::string command;
+};
+
+inline std::ostream &operator<<(std::ostream &os, const TraceEvent &e) {
+    const char *kinds[] = {"land", "execute_begin", "dispatch", "probe",
+                           "run", "stop", "execute_end"};
+    os << kinds[static_cast<int>(e.kind)];
+    switch (e.kind) {
+        case TraceEvent::Kind::DISPATCH:
+            return os << " " << e.command;
+        case TraceEvent::Kind::PROBE:
+        case TraceEvent::Kind::RUN:
+            return os << " sensor " << e.sensor << " (" << e.x << ", " << e.y
+                      << ") " << e.value;
+        default:
+            return os << " (" << e.x << ", " << e.y << ") " << e.value;
+    }
+}
+
+// The latest capacity events, kept in a ring.
+template <size_t capacity = 4096>
+class TraceObserver : public NullObserver {
+private:
+    std::vector<TraceEvent> ring;
+    uint64_t recorded = 0;
+
+    void record(TraceEvent e) {
+        if (ring.size() < capacity)
+            ring.push_back(std::move(e));
+        else
+            ring[recorded % capacity] = std::move(e);
+        ++recorded;
+    }
+
+    void at(TraceEvent::Kind kind, const Position &p, int64_t value) {
+        record({kind, 0, p.get_coordinates().get_x(),
+                p.get_coordinates().get_y(), value, {}});
+    }
+
+public:
+    constexpr static bool enabled = true;
+
+    void on_land(const Position &p) {
+        at(TraceEvent::Kind::LAND, p, static_cast<int64_t>(p.get_direction()));
+    }
+
+    void on_execute_begin(const Position &p) {
+        at(TraceEvent::Kind::EXECUTE_BEGIN, p,
+           static_cast<int64_t>(p.get_direction()));
+    }
+
+    void on_dispatch(std::string_view command) {
+        record({TraceEvent::Kind::DISPATCH, 0, 0, 0, 0, std::string(command)});
+    }
+
+    void on_probe(size_t sensor, coordinate_t x, coordinate_t y, bool safe) {
+        record({TraceEvent::Kind::PROBE, static_cast<uint32_t>(sensor), x, y,
+                safe, {}});
+    }
+
+    void on_run(size_t sensor, coordinate_t x, coordinate_t y,
+                [[maybe_unused]] Direction d,
+                [[maybe_unused]] coordinate_t limit, coordinate_t free) {
+        record({TraceEvent::Kind::RUN, static_cast<uint32_t>(sensor), x, y,
+                free, {}});
+    }
+
+    void on_stop(const Position &p, StopReason reason) {
+        at(TraceEvent::Kind::STOP, p, static_cast<int64_t>(reason));
+    }
+
+    void on_execute_end(const Position &p,
+                        [[maybe_unused]] StopReason reason) {
+        at(TraceEvent::Kind::EXECUTE_END, p,
+           static_cast<int64_t>(p.get_direction()));
+    }
+
+    // Number of events recorded, including those overwritten since.
+    uint64_t size() const {
+        return recorded;
+    }
+
+    // The events kept, oldest first.
+    std::vector<TraceEvent> events() const {
+        std::vector<TraceEvent> result;
+        size_t first = recorded < capacity ? 0 : recorded % capacity;
+        for (size_t i = 0; i < ring.size(); ++i)
+            result.push_back(ring[(first + i) % ring.size()]);
+        return result;
+    }
+
+    void clear() {
+        ring.clear();
+        recorded = 0;
+    }
+};
+
+#endif //OBSERVERS_H
@@ -0,0 +1,386 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <vector>
+#include "rover.h"
+#include "thread_shards.h"
+
+#ifdef __linux__
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Hardware events counted by PerfCounterGroup.
+enum class PerfEvent {
+    CYCLES,
+    INSTRUCTIONS,
+    CACHE_REFERENCES,
+    CACHE_MISSES,
+    BRANCHES,
+    BRANCH_MISSES
+};
+
+constexpr size_t PERF_EVENTS = 6;
+
+// Parts of the engine a PerfProfile attributes counts to. EXECUTE
+// includes the SENSORS of its commands.
+enum class PerfPhase {
+    EXECUTE,
+    SENSORS,
+    FLEET
+};
+
+constexpr size_t PERF_PHASES = 3;
+
+// Counter values; events the machine could not count are left out of
+// counted.
+struct PerfReading {
+    std::array<uint64_t, PERF_EVENTS> values = {};
+    uint32_t counted = 0;
+
+    uint64_t operator[](PerfEvent e) const {
+        return values[static_cast<size_t>(e)];
+    }
+
+    bool has(PerfEvent e) const {
+        return counted >> static_cast<size_t>(e) & 1;
+    }
+};
+
+// Counters of the calling thread's user-space execution, opened as
+// perf_event groups read together: cycles with instructions, and cache
+// and branch events with each other, so that every ratio reported comes
+// from one group and a PMU too small for all six events still counts
+// some of them. Without Linux, or when perf_event_open is refused (as
+// under a high perf_event_paranoid or in many containers), the counters
+// are not available and read nothing; events the CPU lacks are left
+// out, and so are groups the kernel never got to schedule.
+class PerfCounterGroup {
+private:
+    struct Group {
+        std::vector<int> fds;
+        // Events in the order they were added to the group.
+        std::vector<PerfEvent> events;
+    };
+
+    std::vector<Group> groups;
+
+public:
+    PerfCounterGroup() {
+#ifdef __linux__
+        constexpr uint64_t configs[PERF_EVENTS] = {
+                PERF_COUNT_HW_CPU_CYCLES,
+                PERF_COUNT_HW_INSTRUCTIONS,
+                PERF_COUNT_HW_CACHE_REFERENCES,
+                PERF_COUNT_HW_CACHE_MISSES,
+                PERF_COUNT_HW_BRANCH_INSTRUCTIONS,
+                PERF_COUNT_HW_BRANCH_MISSES};
+        const std::vector<PerfEvent> members[] = {
+                {PerfEvent::CYCLES, PerfEvent::INSTRUCTIONS},
+                {PerfEvent::CACHE_REFERENCES, PerfEvent::CACHE_MISSES,
+                 PerfEvent::BRANCHES, PerfEvent::BRANCH_MISSES}};
+        for (const auto &events : members) {
+            Group group;
+            for (PerfEvent e : events) {
+                perf_event_attr attr;
+                std::memset(&attr, 0, sizeof(attr));
+                attr.size = sizeof(attr);
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = configs[static_cast<size_t>(e)];
+                attr.read_format = PERF_FORMAT_GROUP |
+                                   PERF_FORMAT_TOTAL_TIME_ENABLED |
+                                   PERF_FORMAT_TOTAL_TIME_RUNNING;
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                // The first event opened leads the group.
+                int leader = group.fds.empty() ? -1 : group.fds[0];
+                auto fd = static_cast<int>(syscall(SYS_perf_event_open, &attr,
+                                                   0, -1, leader, 0));
+                if (fd < 0)
+                    continue;
+                group.fds.push_back(fd);
+                group.events.push_back(e);
+            }
+            if (!group.fds.empty())
+                groups.push_back(std::move(group));
+        }
+#endif
+    }
+
+    ~PerfCounterGroup() {
+#ifdef __linux__
+        for (const Group &group : groups)
+            for (int fd : group.fds)
+                close(fd);
+#endif
+    }
+
+    PerfCounterGroup(const PerfCounterGroup &) = delete;
+    PerfCounterGroup &operator=(const PerfCounterGroup &) = delete;
+
+    bool available() const {
+        return !groups.empty();
+    }
+
+    // Counts since the counters were opened, scaled up when the kernel had
+    // to share them with other groups; a system call per group. Empty
+    // when not available.
+    PerfReading read() const {
+        PerfReading r;
+#ifdef __linux__
+        for (const Group &group : groups) {
+            // nr, time enabled, time running and a value per event.
+            uint64_t buffer[3 + PERF_EVENTS];
+            auto size = static_cast<ssize_t>((3 + group.events.size()) *
+                                             sizeof(uint64_t));
+            if (::read(group.fds[0], buffer, sizeof(buffer)) != size ||
+                    buffer[2] == 0)
+                continue;
+            double scale = static_cast<double>(buffer[1]) /
+                           static_cast<double>(buffer[2]);
+            for (size_t i = 0; i < group.events.size(); ++i) {
+                auto e = static_cast<size_t>(group.events[i]);
+                r.values[e] = static_cast<uint64_t>(
+                        static_cast<double>(buffer[3 + i]) * scale);
+                r.counted |= uint32_t{1} << e;
+            }
+        }
+#endif
+        return r;
+    }
+};
+
+// Counts attributed to one phase, with the metrics derived from them.
+// A metric is empty when an event it needs was not counted.
+struct PerfCounts {
+    uint64_t intervals = 0;
+    PerfReading totals;
+
+    std::optional<double> ipc() const {
+        return ratio(PerfEvent::INSTRUCTIONS, PerfEvent::CYCLES);
+    }
+
+    std::optional<double> cache_miss_rate() const {
+        return ratio(PerfEvent::CACHE_MISSES, PerfEvent::CACHE_REFERENCES);
+    }
+
+    std::optional<double> branch_miss_rate() const {
+        return ratio(PerfEvent::BRANCH_MISSES, PerfEvent::BRANCHES);
+    }
+
+private:
+    std::optional<double> ratio(PerfEvent part, PerfEvent whole) const {
+        if (!totals.has(part) || !totals.has(whole) || totals[whole] == 0)
+            return std::nullopt;
+        return static_cast<double>(totals[part]) /
+               static_cast<double>(totals[whole]);
+    }
+};
+
+// Counts of every phase, merged over all threads.
+struct PerfReport {
+    // Whether any thread's counters counted anything.
+    bool available = false;
+    std::array<PerfCounts, PERF_PHASES> phases;
+
+    const PerfCounts &operator[](PerfPhase phase) const {
+        return phases[static_cast<size_t>(phase)];
+    }
+};
+
+inline std::ostream &operator<<(std::ostream &os, const PerfReport &report) {
+    if (!report.available)
+        return os << "hardware counters unavailable\n";
+    const char *names[] = {"execute", "sensors", "fleet"};
+    auto metric = [&os](std::optional<double> m) -> std::ostream & {
+        return m ? os << *m : os << "-";
+    };
+    for (size_t i = 0; i < PERF_PHASES; ++i) {
+        const PerfCounts &c = report.phases[i];
+        if (c.intervals == 0)
+            continue;
+        os << names[i] << ": " << c.intervals << " intervals, "
+           << c.totals[PerfEvent::CYCLES] << " cycles, "
+           << c.totals[PerfEvent::INSTRUCTIONS] << " instructions, ipc ";
+        metric(c.ipc()) << ", cache miss rate ";
+        metric(c.cache_miss_rate()) << ", branch miss rate ";
+        metric(c.branch_miss_rate()) << "\n";
+    }
+    return os;
+}
+
+// Hardware counts of engine phases on any number of threads. Each thread
+// opens its own counters on first use and adds to its own shard, so
+// counting takes no locks; report() merges the shards. Every begin or
+// end reads the counters with a system call, some hundreds of
+// nanoseconds, so short phases are best sampled (see PerfObserver).
+class PerfProfile {
+public:
+    class Shard {
+    private:
+        PerfCounterGroup group;
+        std::array<PerfReading, PERF_PHASES> started;
+        std::array<std::atomic<uint64_t>, PERF_PHASES> intervals = {};
+        std::array<std::array<std::atomic<uint64_t>, PERF_EVENTS>,
+                   PERF_PHASES> totals = {};
+        uint32_t counted = 0;
+
+        static void bump(std::atomic<uint64_t> &a, uint64_t by) {
+            a.store(a.load(std::memory_order_relaxed) + by,
+                    std::memory_order_relaxed);
+        }
+
+        friend class PerfProfile;
+
+    public:
+        void begin(PerfPhase phase) {
+            if (group.available())
+                started[static_cast<size_t>(phase)] = group.read();
+        }
+
+        void end(PerfPhase phase) {
+            if (!group.available())
+                return;
+            PerfReading now = group.read();
+            auto p = static_cast<size_t>(phase);
+            const PerfReading &start = started[p];
+            // Intervals the kernel counted nothing of, or not the same
+            // events throughout, are left out.
+            if (now.counted == 0 || now.counted != start.counted)
+                return;
+            for (size_t e = 0; e < PERF_EVENTS; ++e)
+                bump(totals[p][e], now.values[e] - start.values[e]);
+            bump(intervals[p], 1);
+            counted |= now.counted;
+        }
+    };
+
+    // Counts one phase for as long as it lives:
+    //
+    //     {
+    //         PerfProfile::Scope batch(profile, PerfPhase::FLEET);
+    //         fleet.execute(commands);
+    //     }
+    class Scope {
+    private:
+        Shard &shard;
+        PerfPhase phase;
+    public:
+        Scope(PerfProfile &profile, PerfPhase phase) :
+            shard(profile.shard()), phase(phase) {
+            shard.begin(phase);
+        }
+
+        ~Scope() {
+            shard.end(phase);
+        }
+
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+    };
+
+private:
+    ThreadShards<Shard> shards;
+
+public:
+    PerfProfile() = default;
+    PerfProfile(const PerfProfile &) = delete;
+    PerfProfile &operator=(const PerfProfile &) = delete;
+
+    // The calling thread's shard, its counters opened on first use.
+    Shard &shard() {
+        return shards.local([] { return std::make_unique<Shard>(); });
+    }
+
+    PerfReport report() const {
+        PerfReport result;
+        shards.for_each([&](const Shard &shard) {
+            // Counters opened but never scheduled count as unavailable.
+            result.available |= shard.counted != 0;
+            for (size_t p = 0; p < PERF_PHASES; ++p) {
+                PerfCounts &c = result.phases[p];
+                c.intervals +=
+                        shard.intervals[p].load(std::memory_order_relaxed);
+                for (size_t e = 0; e < PERF_EVENTS; ++e)
+                    c.totals.values[e] +=
+                            shard.totals[p][e].load(std::memory_order_relaxed);
+                c.totals.counted |= shard.counted;
+            }
+        });
+        return result;
+    }
+};
+
+// Observer counting one execute in 2^period_log2 and the sensors it
+// asks in a PerfProfile. Rovers start without a profile and count
+// nothing until attached to one:
+//
+//     struct Profiled : DefaultRoverPolicy {
+//         using observer_type = PerfObserver<4>;
+//     };
+//     PerfProfile profile;
+//     rover.observer().attach(profile);
+//     ...
+//     std::cout << profile.report();
+template <unsigned period_log2 = 0>
+class PerfObserver : public NullObserver {
+private:
+    PerfProfile *profile = nullptr;
+    PerfProfile::Shard *shard = nullptr;
+    uint64_t executes = 0;
+
+public:
+    constexpr static bool enabled = true;
+
+    void attach(PerfProfile &p) {
+        profile = &p;
+    }
+
+    void on_execute_begin([[maybe_unused]] const Position &p) {
+        bool sampled =
+                (executes++ & ((uint64_t{1} << period_log2) - 1)) == 0;
+        // The rover may run on another thread than the last time.
+        shard = profile != nullptr && sampled ? &profile->shard() : nullptr;
+        if (shard != nullptr)
+            shard->begin(PerfPhase::EXECUTE);
+    }
+
+    void on_probe_begin([[maybe_unused]] size_t sensor) {
+        if (shard != nullptr)
+            shard->begin(PerfPhase::SENSORS);
+    }
+
+    void on_probe([[maybe_unused]] size_t sensor,
+                  [[maybe_unused]] coordinate_t x,
+                  [[maybe_unused]] coordinate_t y,
+                  [[maybe_unused]] bool safe) {
+        if (shard != nullptr)
+            shard->end(PerfPhase::SENSORS);
+    }
+
+    void on_run([[maybe_unused]] size_t sensor,
+                [[maybe_unused]] coordinate_t x,
+                [[maybe_unused]] coordinate_t y,
+                [[maybe_unused]] Direction d,
+                [[maybe_unused]] coordinate_t limit,
+                [[maybe_unused]] coordinate_t free) {
+        if (shard != nullptr)
+            shard->end(PerfPhase::SENSORS);
+    }
+
+    void on_execute_end([[maybe_unused]] const Position &p,
+                        [[maybe_unused]] StopReason reason) {
+        if (shard != nullptr)
+            shard->end(PerfPhase::EXECUTE);
+        shard = nullptr;
+    }
+};
+
+#endif //PERF_COUNTERS_H
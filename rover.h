@@ -6,9 +6,39 @@
 #include <map>
 #include <string>
 #include <memory>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <compare>
+#include <concepts>
+#include <cstdint>
+#include <limits>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <typeinfo>
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
 
 using coordinate_t = int32_t;
 
+// Sum wrapping around the coordinate range instead of overflowing.
+constexpr coordinate_t wrapping_add(coordinate_t a, coordinate_t b) {
+    return static_cast<coordinate_t>(static_cast<uint32_t>(a) +
+                                     static_cast<uint32_t>(b));
+}
+
+template <std::signed_integral T>
+constexpr T wrapping_add(T a, T b) {
+    using U = std::make_unsigned_t<T>;
+    return static_cast<T>(static_cast<U>(static_cast<U>(a) +
+                                         static_cast<U>(b)));
+}
+
+enum class Direction : uint8_t { NORTH = 0, EAST = 1, SOUTH = 2, WEST = 3 };
+
 // Abstract class responsible for sensors.
 class Sensor {
 public:
@@ -16,10 +46,163 @@ public:
     virtual ~Sensor() = default;
 
     virtual bool is_safe(coordinate_t, coordinate_t) = 0;
+
+    // Batch query: bit i of the result is set iff (x + i, y) is safe,
+    // for 0 <= i < width <= 64, x + i wrapping around the coordinate
+    // range. Sensors that can answer a whole span at once should
+    // override it.
+    virtual uint64_t safe_row(coordinate_t x, coordinate_t y, int width) {
+        uint64_t mask = 0;
+        for (int i = 0; i < width; ++i) {
+            if (is_safe(wrapping_add(x, i), y))
+                mask |= uint64_t{1} << i;
+        }
+        return mask;
+    }
+
+    // Segment query: number of consecutive safe cells met when walking
+    // from (x, y) in direction d, not counting (x, y) itself and stopping
+    // after limit cells. Sensors that can answer a straight run at once
+    // should override it.
+    virtual coordinate_t safe_run(coordinate_t x, coordinate_t y,
+                                  Direction d, coordinate_t limit);
 };
 
 using sensors_t = std::vector<std::shared_ptr<Sensor>>;
 
+using world_version_t = uint64_t;
+
+// Version stamp of the world described by the sensors. Whoever changes
+// the world bumps it, which drops every safety verdict cached before.
+class WorldVersion {
+private:
+    std::atomic<world_version_t> value{0};
+public:
+    world_version_t get() const {
+        return value.load(std::memory_order_acquire);
+    }
+
+    void bump() {
+        value.fetch_add(1, std::memory_order_acq_rel);
+    }
+};
+
+// Sensor remembering the verdicts on cells around the rover, so that
+// moves inside that window do not go through the sensors again. The
+// window is a direct-mapped set of 64-cell row bitmaps indexed by y,
+// filled lazily: each cell is asked about once, and batch queries fill
+// the span they cover. A row is recentred on the rover when it leaves
+// it, hence the window slides along. Segment queries take what the
+// window holds, fill the part of the rover's row they cross with one
+// batch query, and pass the rest on as segment queries, so that a long
+// run costs about as much as without the cache.
+class SafeRegionCache : public Sensor {
+private:
+    constexpr static int ROWS = 64;
+    constexpr static int ROW_WIDTH = 64;
+
+    struct Row {
+        coordinate_t x0 = 0, y = 0;
+        // Cells asked about, and which of them are safe.
+        uint64_t known = 0, safe = 0;
+        bool valid = false;
+    };
+
+    sensors_t sensors;
+    std::shared_ptr<const WorldVersion> version;
+    world_version_t stamp = 0;
+    std::array<Row, ROWS> rows{};
+
+    static Row &slot(std::array<Row, ROWS> &rows, coordinate_t y) {
+        return rows[static_cast<uint32_t>(y) % ROWS];
+    }
+
+    static bool covers(const Row &row, coordinate_t x, coordinate_t y) {
+        int64_t offset = int64_t{x} - row.x0;
+        return row.valid && row.y == y && offset >= 0 && offset < ROW_WIDTH;
+    }
+
+    void check_version() {
+        if (version && version->get() != stamp) {
+            invalidate();
+            stamp = version->get();
+        }
+    }
+
+    // Centres an empty row around x, keeping it inside the coordinate
+    // range.
+    static void recentre(Row &row, coordinate_t x, coordinate_t y) {
+        int64_t x0 = int64_t{x} - ROW_WIDTH / 2;
+        x0 = std::max<int64_t>(x0, INT32_MIN);
+        x0 = std::min<int64_t>(x0, int64_t{INT32_MAX} - ROW_WIDTH + 1);
+        row.x0 = static_cast<coordinate_t>(x0);
+        row.y = y;
+        row.known = row.safe = 0;
+        row.valid = true;
+    }
+
+    Row &lookup(coordinate_t x, coordinate_t y) {
+        check_version();
+        Row &row = slot(rows, y);
+        if (!covers(row, x, y))
+            recentre(row, x, y);
+        return row;
+    }
+
+public:
+    SafeRegionCache(sensors_t sensors_,
+                    std::shared_ptr<const WorldVersion> version_ = nullptr) :
+        sensors(std::move(sensors_)), version(std::move(version_)),
+        stamp(version ? version->get() : 0) {}
+
+    bool is_safe(coordinate_t x, coordinate_t y) override {
+        Row &row = lookup(x, y);
+        uint64_t bit = uint64_t{1} << (x - row.x0);
+        if (!(row.known & bit)) {
+            row.known |= bit;
+            bool safe = true;
+            for (const auto &sensor : sensors) {
+                if (!sensor->is_safe(x, y)) {
+                    safe = false;
+                    break;
+                }
+            }
+            if (safe)
+                row.safe |= bit;
+        }
+        return row.safe & bit;
+    }
+
+    uint64_t safe_row(coordinate_t x, coordinate_t y, int width) override {
+        Row &row = lookup(x, y);
+        int shift = x - row.x0;
+        if (shift + width > ROW_WIDTH)
+            return Sensor::safe_row(x, y, width);
+        uint64_t span = width == 64 ? ~uint64_t{0}
+                                    : (uint64_t{1} << width) - 1;
+        if ((row.known >> shift & span) != span) {
+            uint64_t safe = span;
+            for (const auto &sensor : sensors) {
+                safe &= sensor->safe_row(x, y, width);
+                if (safe == 0)
+                    break;
+            }
+            row.known |= span << shift;
+            row.safe = (row.safe & ~(span << shift)) | safe << shift;
+        }
+        return row.safe >> shift & span;
+    }
+
+    coordinate_t safe_run(coordinate_t x, coordinate_t y, Direction d,
+                          coordinate_t limit) override;
+
+    // Forgets every cached verdict.
+    void invalidate() {
+        for (auto &row : rows)
+            row.valid = false;
+    }
+};
+
 // An exception that is raised when rover is heading towards a dangerous
 // field.
 class DangerousField : public std::exception {
@@ -38,32 +221,61 @@ public:
     }
 };
 
-// Class responsible for managing coordinates, adding them etc.
-class Coordinates {
+// An exception that is raised when coordinates do not fit the
+// coordinate type of a rover.
+class CoordinatesOutOfRange : public std::exception {
+public:
+    const char *what() const noexcept override {
+        return "Coordinates out of range";
+    }
+};
+
+// Class responsible for managing coordinates, adding them etc. Rovers on
+// small maps may use coordinates narrower than coordinate_t.
+template <std::signed_integral T>
+class BasicCoordinates {
 protected:
-    coordinate_t x, y;
+    T x, y;
 
 public:
-    constexpr Coordinates(coordinate_t x, coordinate_t y) : x(x), y(y) {}
-    ~Coordinates() = default;
+    constexpr BasicCoordinates(T x, T y) : x(x), y(y) {}
+    ~BasicCoordinates() = default;
+
+    constexpr T get_x() const { return x; }
+    constexpr T get_y() const { return y; }
 
-    void operator+=(const Coordinates &other) {
-        x += other.x;
-        y += other.y;
+    // Each coordinate wraps around the coordinate range on its own.
+    void operator+=(const BasicCoordinates &other) {
+        x = wrapping_add(x, other.x);
+        y = wrapping_add(y, other.y);
     }
 
     bool is_safe(std::shared_ptr<Sensor> sensor) {
         return sensor->is_safe(x, y);
     }
 
+    bool is_safe(Sensor &sensor) const {
+        return sensor.is_safe(x, y);
+    }
+
     friend std::ostream& operator<<(std::ostream& os,
-            const Coordinates &coordinates) {
-        os << "(" << coordinates.x << ", " << coordinates.y << ")";
+            const BasicCoordinates &coordinates) {
+        os << "(" << int64_t{coordinates.x} << ", "
+           << int64_t{coordinates.y} << ")";
         return os;
     }
 };
 
-enum class Direction { NORTH = 0, EAST = 1, SOUTH = 2, WEST = 3 };
+using Coordinates = BasicCoordinates<coordinate_t>;
+
+// The same coordinates of another width. Throws CoordinatesOutOfRange
+// when they do not fit.
+template <std::signed_integral To, std::signed_integral From>
+BasicCoordinates<To> convert_coordinates(const BasicCoordinates<From> &c) {
+    if (!std::in_range<To>(c.get_x()) || !std::in_range<To>(c.get_y()))
+        throw CoordinatesOutOfRange();
+    return {static_cast<To>(c.get_x()), static_cast<To>(c.get_y())};
+}
 
 // Assignment of consts to specific direction.
 class DirectionManager {
@@ -75,9 +287,21 @@ private:
     constexpr static std::string_view direction_name[DIRECTIONS_NO] =
             {"NORTH", "EAST", "SOUTH", "WEST"};
 public:
+    // Directions are numbered clockwise, so turning is a masked add.
     static Direction get_next(const Direction d) {
         int index = static_cast<int>(d);
-        return static_cast<Direction>((index + 1) % DIRECTIONS_NO);
+        return static_cast<Direction>((index + 1) & (DIRECTIONS_NO - 1));
+    }
+
+    static Direction get_previous(const Direction d) {
+        int index = static_cast<int>(d);
+        return static_cast<Direction>(
+                (index + DIRECTIONS_NO - 1) & (DIRECTIONS_NO - 1));
+    }
+
+    static Direction get_opposite(const Direction d) {
+        int index = static_cast<int>(d);
+        return static_cast<Direction>((index + 2) & (DIRECTIONS_NO - 1));
     }
 
     static Coordinates get_move(const Direction d) {
@@ -87,37 +311,395 @@ public:
     static std::string_view get_name(const Direction d) {
         return direction_name[static_cast<int>(d)];
     }
+
+    // Turns a vector given for a rover heading north towards d.
+    static Coordinates rotate(coordinate_t x, coordinate_t y,
+                              const Direction d) {
+        auto minus_x = static_cast<coordinate_t>(0u - static_cast<uint32_t>(x));
+        auto minus_y = static_cast<coordinate_t>(0u - static_cast<uint32_t>(y));
+        switch (d) {
+            case Direction::NORTH: return {x, y};
+            case Direction::EAST: return {y, minus_x};
+            case Direction::SOUTH: return {minus_x, minus_y};
+            case Direction::WEST: return {minus_y, x};
+        }
+        return {x, y};
+    }
+
+    static coordinate_t get_dx(const Direction d) {
+        return d == Direction::EAST ? 1 : d == Direction::WEST ? -1 : 0;
+    }
+
+    static coordinate_t get_dy(const Direction d) {
+        return d == Direction::NORTH ? 1 : d == Direction::SOUTH ? -1 : 0;
+    }
+
+    // How many steps of size delta can be made from c before leaving
+    // the coordinate range (capped at INT32_MAX).
+    static coordinate_t room(coordinate_t c, coordinate_t delta) {
+        int64_t steps = INT32_MAX;
+        if (delta > 0)
+            steps = int64_t{INT32_MAX} - c;
+        else if (delta < 0)
+            steps = int64_t{c} - INT32_MIN;
+        return static_cast<coordinate_t>(std::min<int64_t>(steps, INT32_MAX));
+    }
+};
+
+inline coordinate_t Sensor::safe_run(coordinate_t x, coordinate_t y,
+                                     Direction d, coordinate_t limit) {
+    coordinate_t dx = DirectionManager::get_dx(d);
+    coordinate_t dy = DirectionManager::get_dy(d);
+    limit = std::min({limit, DirectionManager::room(x, dx),
+                      DirectionManager::room(y, dy)});
+    for (coordinate_t k = 0; k < limit; ++k) {
+        x += dx;
+        y += dy;
+        if (!is_safe(x, y))
+            return k;
+    }
+    return limit;
+}
+
+// Asks a sensor held by value, a shared sensor or every sensor of a list
+// whether a field is safe.
+template <class S>
+    requires requires(S &sensor) { sensor.is_safe(0, 0); }
+bool sensors_are_safe(S &sensor, coordinate_t x, coordinate_t y) {
+    return sensor.is_safe(x, y);
+}
+
+template <class S>
+bool sensors_are_safe(const std::shared_ptr<S> &sensor,
+                      coordinate_t x, coordinate_t y) {
+    return sensor->is_safe(x, y);
+}
+
+inline bool sensors_are_safe(const sensors_t &sensors,
+                             coordinate_t x, coordinate_t y) {
+    for (const auto &sensor : sensors) {
+        if (!sensor->is_safe(x, y))
+            return false;
+    }
+    return true;
+}
+
+// Segment query asked to a sensor held by value, a shared sensor or
+// every sensor of a list: how many safe fields follow (x, y) towards d,
+// at most limit. Sensors without safe_run are asked field by field.
+template <class S>
+    requires requires(S &sensor) { sensor.is_safe(0, 0); }
+coordinate_t sensors_safe_run(S &sensor, coordinate_t x, coordinate_t y,
+                              Direction d, coordinate_t limit) {
+    if constexpr (requires { sensor.safe_run(x, y, d, limit); }) {
+        return sensor.safe_run(x, y, d, limit);
+    }
+    else {
+        coordinate_t dx = DirectionManager::get_dx(d);
+        coordinate_t dy = DirectionManager::get_dy(d);
+        limit = std::min({limit, DirectionManager::room(x, dx),
+                          DirectionManager::room(y, dy)});
+        for (coordinate_t k = 0; k < limit; ++k) {
+            x += dx;
+            y += dy;
+            if (!sensor.is_safe(x, y))
+                return k;
+        }
+        return limit;
+    }
+}
+
+template <class S>
+coordinate_t sensors_safe_run(const std::shared_ptr<S> &sensor,
+                              coordinate_t x, coordinate_t y,
+                              Direction d, coordinate_t limit) {
+    return sensors_safe_run(*sensor, x, y, d, limit);
+}
+
+inline coordinate_t sensors_safe_run(const sensors_t &sensors,
+                                     coordinate_t x, coordinate_t y,
+                                     Direction d, coordinate_t limit) {
+    for (const auto &sensor : sensors) {
+        if (limit == 0)
+            break;
+        limit = sensor->safe_run(x, y, d, limit);
+    }
+    return limit;
+}
+
+inline coordinate_t SafeRegionCache::safe_run(coordinate_t x, coordinate_t y,
+                                              Direction d,
+                                              coordinate_t limit) {
+    check_version();
+    coordinate_t step_x = DirectionManager::get_dx(d);
+    coordinate_t step_y = DirectionManager::get_dy(d);
+    limit = std::min({limit, DirectionManager::room(x, step_x),
+                      DirectionManager::room(y, step_y)});
+    int64_t dx = step_x, dy = step_y;
+
+    // Ranges of steps along the run whose cells the window holds, in
+    // order: the span of the rover's row going east or west, the cells
+    // asked about before going north or south.
+    std::array<std::pair<int64_t, int64_t>, ROWS> held;
+    size_t n = 0;
+    if (dy == 0) {
+        const Row &row = slot(rows, y);
+        if (row.valid && row.y == y) {
+            int64_t first = dx > 0 ? int64_t{row.x0} - x
+                                   : int64_t{x} - row.x0 - (ROW_WIDTH - 1);
+            int64_t last = std::min<int64_t>(first + ROW_WIDTH - 1, limit);
+            first = std::max<int64_t>(first, 1);
+            if (first <= last)
+                held[n++] = {first, last};
+        }
+    }
+    else {
+        for (const Row &row : rows) {
+            int64_t k = (int64_t{row.y} - y) * dy;
+            if (k >= 1 && k <= limit && covers(row, x, row.y) &&
+                    (row.known >> (x - row.x0) & 1))
+                held[n++] = {k, k};
+        }
+        std::sort(held.begin(), held.begin() + n);
+    }
+
+    // Steps known to be safe so far.
+    int64_t done = 0;
+    auto forward = [&](int64_t steps) {
+        coordinate_t free = sensors_safe_run(
+                sensors, static_cast<coordinate_t>(x + dx * done),
+                static_cast<coordinate_t>(y + dy * done), d,
+                static_cast<coordinate_t>(steps));
+        done += free;
+        return free == steps;
+    };
+    for (size_t i = 0; i < n; ++i) {
+        auto [first, last] = held[i];
+        if (first - 1 > done && !forward(first - 1 - done))
+            return static_cast<coordinate_t>(done);
+        int width = static_cast<int>(last - first + 1);
+        int free;
+        if (dy == 0) {
+            int64_t from = x + dx * first, to = x + dx * last;
+            uint64_t safe = safe_row(static_cast<coordinate_t>(
+                    std::min(from, to)), y, width);
+            free = dx > 0 ? std::countr_one(safe)
+                          : std::countl_one(safe << (ROW_WIDTH - width));
+        }
+        else {
+            const Row &row = slot(rows, static_cast<coordinate_t>(
+                    y + dy * first));
+            free = static_cast<int>(row.safe >> (x - row.x0) & 1);
+        }
+        done = first - 1 + std::min(free, width);
+        if (free < width)
+            return static_cast<coordinate_t>(done);
+    }
+    if (limit > done)
+        forward(limit - done);
+    return static_cast<coordinate_t>(done);
+}
+
+// Questions an interpreter asks about fields, answered by all sensors of
+// a list.
+class SensorListProbe {
+private:
+    const sensors_t &sensors;
+public:
+    SensorListProbe(const sensors_t &sensors) : sensors(sensors) {}
+
+    bool is_safe(coordinate_t x, coordinate_t y) const {
+        return sensors_are_safe(sensors, x, y);
+    }
+
+    coordinate_t safe_run(coordinate_t x, coordinate_t y, Direction d,
+                          coordinate_t limit) const {
+        return sensors_safe_run(sensors, x, y, d, limit);
+    }
 };
 
+// Fields a rover driving until unsafe from (x, y) towards d goes, at
+// most limit. Segment queries end at the edge of the coordinate range,
+// while single moves wrap around it: the run goes on from the other edge
+// as a string of single moves would. Asking about the field across the
+// edge is not a reason to stop, so a probe's last refusal is kept.
+template <class Probe>
+coordinate_t until_unsafe_run(Probe &probe, coordinate_t x, coordinate_t y,
+                              Direction d, coordinate_t limit) {
+    coordinate_t dx = DirectionManager::get_dx(d);
+    coordinate_t dy = DirectionManager::get_dy(d);
+    coordinate_t done = 0;
+    while (true) {
+        coordinate_t free = probe.safe_run(x, y, d, limit - done);
+        done += free;
+        if (done == limit || free < std::min(DirectionManager::room(x, dx),
+                                             DirectionManager::room(y, dy)))
+            return done;
+        x = wrapping_add(wrapping_add(x, dx * free), dx);
+        y = wrapping_add(wrapping_add(y, dy * free), dy);
+        bool safe;
+        if constexpr (requires { probe.last; }) {
+            auto last = probe.last;
+            safe = probe.is_safe(x, y);
+            probe.last = last;
+        }
+        else {
+            safe = probe.is_safe(x, y);
+        }
+        if (!safe)
+            return done;
+        ++done;
+    }
+}
+
+// Two coordinates packed in one word, laid out as an array of x and y.
+template <std::signed_integral T>
+constexpr auto pack_coordinates(T x, T y) {
+    using U = std::make_unsigned_t<T>;
+    using word_t = std::conditional_t<sizeof(T) == 2, uint32_t, uint64_t>;
+    return std::bit_cast<word_t>(std::array<U, 2>{static_cast<U>(x),
+                                                  static_cast<U>(y)});
+}
+
 // Connects coordinates with direction, allows rover to move.
-class Position {
+//
+// Both coordinates are kept packed in one word, so a step is a single add
+// of a precomputed packed delta. The add is done lane-wise: each
+// coordinate wraps around the coordinate range on its own, the carry out
+// of one never reaching the other.
+template <std::signed_integral T>
+    requires (sizeof(T) == 2 || sizeof(T) == 4)
+class BasicPosition {
 private:
-    Coordinates coordinates;
+    using halves_t = std::array<std::make_unsigned_t<T>, 2>;
+    using word_t = decltype(pack_coordinates(T{}, T{}));
+
+    constexpr static word_t LANE_SIGNS = pack_coordinates(
+            std::numeric_limits<T>::min(), std::numeric_limits<T>::min());
+
+    halves_t halves;
     Direction direction;
+
+    // Packed steps forward, by direction.
+    constexpr static word_t step[4] = {
+        pack_coordinates<T>(0, 1), pack_coordinates<T>(1, 0),
+        pack_coordinates<T>(0, -1), pack_coordinates<T>(-1, 0)
+    };
+
+    constexpr static word_t add_lanes(word_t a, word_t b) {
+        return ((a & ~LANE_SIGNS) + (b & ~LANE_SIGNS)) ^
+               ((a ^ b) & LANE_SIGNS);
+    }
+
+    void move_by(word_t delta) {
+        halves = std::bit_cast<halves_t>(
+                add_lanes(std::bit_cast<word_t>(halves), delta));
+    }
+
 public:
-    Position(Coordinates coordinates, Direction direction) :
-        coordinates(coordinates), direction(direction) {}
+    BasicPosition(BasicCoordinates<T> coordinates, Direction direction) :
+        halves{static_cast<std::make_unsigned_t<T>>(coordinates.get_x()),
+               static_cast<std::make_unsigned_t<T>>(coordinates.get_y())},
+        direction(direction) {}
+
+    BasicCoordinates<T> get_coordinates() const {
+        return {static_cast<T>(halves[0]), static_cast<T>(halves[1])};
+    }
+
+    Direction get_direction() const { return direction; }
 
     void turn_right() {
         direction = DirectionManager::get_next(direction);
     }
 
+    void turn_left() {
+        direction = DirectionManager::get_previous(direction);
+    }
+
     void go_forward() {
-        coordinates += DirectionManager::get_move(direction);
+        move_by(step[static_cast<int>(direction)]);
+    }
+
+    void go_backward() {
+        move_by(step[static_cast<int>(
+                DirectionManager::get_opposite(direction))]);
+    }
+
+    void go_forward(T steps) {
+        move_by(pack_coordinates<T>(
+                static_cast<T>(DirectionManager::get_dx(direction) * steps),
+                static_cast<T>(DirectionManager::get_dy(direction) * steps)));
     }
 
     bool is_safe(std::shared_ptr<Sensor> sensor) {
-        return coordinates.is_safe(std::move(sensor));
+        return is_safe(*sensor);
+    }
+
+    bool is_safe(Sensor &sensor) const {
+        BasicCoordinates<T> c = get_coordinates();
+        return sensor.is_safe(c.get_x(), c.get_y());
     }
 
     friend std::ostream& operator<<(std::ostream& os,
-                                    const Position &position) {
-        os << position.coordinates << " "
+                                    const BasicPosition &position) {
+        os << position.get_coordinates() << " "
             << DirectionManager::get_name(position.direction);
         return os;
     }
 };
 
+using Position = BasicPosition<coordinate_t>;
+
+// The same position with coordinates of another width. Throws
+// CoordinatesOutOfRange when they do not fit.
+template <std::signed_integral To, std::signed_integral From>
+BasicPosition<To> convert_position(const BasicPosition<From> &p) {
+    return {convert_coordinates<To>(p.get_coordinates()), p.get_direction()};
+}
+
+// Sensor reporting every field outside the range of T, less margin
+// fields on each side, as dangerous. A rover with coordinates of type T
+// stops at the edge of its range instead of leaving it.
+template <std::signed_integral T, coordinate_t margin = 0>
+class CoordinateRange : public Sensor {
+public:
+    constexpr static int64_t LOW = int64_t{std::numeric_limits<T>::min()} +
+                                   margin;
+    constexpr static int64_t HIGH = int64_t{std::numeric_limits<T>::max()} -
+                                    margin;
+
+    static bool contains(coordinate_t x, coordinate_t y) {
+        return x >= LOW && x <= HIGH && y >= LOW && y <= HIGH;
+    }
+
+    // How many steps of size delta can be made from c staying in range.
+    static coordinate_t room(coordinate_t c, coordinate_t delta) {
+        int64_t steps = INT32_MAX;
+        if (delta > 0)
+            steps = HIGH - c;
+        else if (delta < 0)
+            steps = c - LOW;
+        return static_cast<coordinate_t>(
+                std::clamp<int64_t>(steps, 0, INT32_MAX));
+    }
+
+    // Segment queries start inside the range.
+    static coordinate_t clamp_run(coordinate_t x, coordinate_t y,
+                                  Direction d, coordinate_t limit) {
+        return std::min({limit, room(x, DirectionManager::get_dx(d)),
+                         room(y, DirectionManager::get_dy(d))});
+    }
+
+    bool is_safe(coordinate_t x, coordinate_t y) override {
+        return contains(x, y);
+    }
+
+    coordinate_t safe_run(coordinate_t x, coordinate_t y, Direction d,
+                          coordinate_t limit) override {
+        return clamp_run(x, y, d, limit);
+    }
+};
+
 // Abstract class for all actions that rover can execute.
 class Action {
 public:
@@ -179,6 +761,28 @@ public:
     }
 };
 
+// Moving forward as far as the sensors allow, at most limit fields. The
+// rover does not stop when it meets a dangerous field, it only stays in
+// front of it. Like single moves, it wraps around the edge of the
+// coordinate range.
+class MoveUntilUnsafe : public Move {
+private:
+    coordinate_t _limit;
+public:
+    MoveUntilUnsafe(coordinate_t limit) : _limit(std::max(limit, 0)) {}
+
+    coordinate_t limit() const {
+        return _limit;
+    }
+
+    void execute(Position &p, const sensors_t &sensors) override {
+        SensorListProbe probe(sensors);
+        p.go_forward(until_unsafe_run(probe, p.get_coordinates().get_x(),
+                                      p.get_coordinates().get_y(),
+                                      p.get_direction(), _limit));
+    }
+};
+
 // Composing many moves into one.
 class Compose : public Action {
 private:
@@ -188,9 +792,25 @@ public:
     Compose(std::vector<std::shared_ptr<Action>> actions) :
         _actions(std::move(actions)) {}
 
+    const std::vector<std::shared_ptr<Action>> &actions() const {
+        return _actions;
+    }
+
+    // Nested Composes are walked with an explicit stack rather than by
+    // recursion, so deep nesting does not overflow the call stack.
     void execute(Position &p, const sensors_t &sensors) override {
-        for (auto & _action : _actions) {
-            _action->execute(p, sensors);
+        std::vector<std::pair<const Compose *, size_t>> stack = {{this, 0}};
+        while (!stack.empty()) {
+            auto &[compose, next] = stack.back();
+            if (next == compose->_actions.size()) {
+                stack.pop_back();
+                continue;
+            }
+            Action &action = *compose->_actions[next++];
+            if (typeid(action) == typeid(Compose))
+                stack.emplace_back(static_cast<const Compose *>(&action), 0);
+            else
+                action.execute(p, sensors);
         }
     }
 };
@@ -211,74 +831,1489 @@ std::shared_ptr<RotateRight> rotate_right() {
     return std::make_shared<RotateRight>();
 }
 
+// Executing one action many times.
+class Repeat : public Action {
+private:
+    uint64_t _times;
+    std::shared_ptr<Action> _action;
+public:
+    Repeat(uint64_t times, std::shared_ptr<Action> action) :
+        _times(times), _action(std::move(action)) {}
+
+    uint64_t times() const {
+        return _times;
+    }
+
+    const std::shared_ptr<Action> &action() const {
+        return _action;
+    }
+
+    void execute(Position &p, const sensors_t &sensors) override {
+        for (uint64_t i = 0; i < _times; ++i)
+            _action->execute(p, sensors);
+    }
+};
+
+std::shared_ptr<MoveUntilUnsafe> move_until_unsafe(
+        coordinate_t limit = INT32_MAX) {
+    return std::make_shared<MoveUntilUnsafe>(limit);
+}
+
 std::shared_ptr<Compose> compose(std::vector<std::shared_ptr<Action>> actions) {
     return std::make_shared<Compose>(actions);
 }
 
+std::shared_ptr<Repeat> repeat(uint64_t times, std::shared_ptr<Action> action) {
+    return std::make_shared<Repeat>(times, std::move(action));
+}
+
 using command_name_t = char;
 using commands_t = std::map<command_name_t, std::shared_ptr<Action>>;
+// Commands named by tokens longer than one character, like "F10".
+using command_tokens_t = std::map<std::string, std::shared_ptr<Action>,
+                                  std::less<>>;
+
+// Double-array trie mapping command tokens to values. All states are
+// slots of one flat array: the child of state s on byte c is the slot
+// base(s) + c + 1, provided that slot's check is s. A match therefore
+// reads one slot per character and never chases pointers.
+class TokenTrie {
+public:
+    constexpr static uint32_t NONE = UINT32_MAX;
 
-class Rover {
 private:
+    struct Slot {
+        int32_t base = 0;
+        // State owning the slot, -1 when free.
+        int32_t check = -1;
+        uint32_t value = NONE;
+    };
+
+    std::vector<Slot> slots;
+
+    static size_t offset(char c) {
+        return static_cast<size_t>(static_cast<unsigned char>(c)) + 1;
+    }
+
+public:
+    TokenTrie() = default;
+
+    // Tokens must not be empty.
+    TokenTrie(const std::vector<std::pair<std::string, uint32_t>> &tokens) {
+        // Plain trie first, its nodes then placed breadth first.
+        struct Node {
+            std::map<unsigned char, uint32_t> children;
+            uint32_t value = NONE;
+        };
+        std::vector<Node> nodes(1);
+        for (const auto &[token, value] : tokens) {
+            uint32_t node = 0;
+            for (char c : token) {
+                auto [it, added] = nodes[node].children.try_emplace(
+                        static_cast<unsigned char>(c),
+                        static_cast<uint32_t>(nodes.size()));
+                node = it->second;
+                if (added)
+                    nodes.emplace_back();
+            }
+            nodes[node].value = value;
+        }
+
+        std::vector<int32_t> state(nodes.size());
+        slots.resize(1);
+        slots[0].check = 0;
+        size_t first_free = 1;
+        std::vector<uint32_t> queue = {0};
+        for (size_t q = 0; q < queue.size(); ++q) {
+            const Node &node = nodes[queue[q]];
+            slots[state[queue[q]]].value = node.value;
+            if (node.children.empty())
+                continue;
+            while (first_free < slots.size() && slots[first_free].check >= 0)
+                ++first_free;
+            // Lowest base putting every child on a free slot.
+            size_t lowest = size_t{node.children.begin()->first} + 1;
+            size_t base = first_free > lowest ? first_free - lowest : 0;
+            for (;; ++base) {
+                bool fits = true;
+                for (const auto &[c, child] : node.children) {
+                    size_t t = base + c + 1;
+                    if (t < slots.size() && slots[t].check >= 0) {
+                        fits = false;
+                        break;
+                    }
+                }
+                if (fits)
+                    break;
+            }
+            size_t last = base + node.children.rbegin()->first + 1;
+            if (last >= slots.size())
+                slots.resize(last + 1);
+            // Resizing moved the slots.
+            slots[state[queue[q]]].base = static_cast<int32_t>(base);
+            for (const auto &[c, child] : node.children) {
+                size_t t = base + c + 1;
+                slots[t].check = state[queue[q]];
+                state[child] = static_cast<int32_t>(t);
+                queue.push_back(child);
+            }
+        }
+    }
+
+    bool empty() const {
+        return slots.empty();
+    }
+
+    // Length of the longest token that text has at position i, 0 when
+    // there is none. The token's value is stored in value.
+    size_t match(std::string_view text, size_t i, uint32_t &value) const {
+        size_t best = 0;
+        size_t s = 0;
+        for (size_t j = i; j < text.size(); ++j) {
+            size_t t = static_cast<size_t>(slots[s].base) + offset(text[j]);
+            if (t >= slots.size() ||
+                    slots[t].check != static_cast<int32_t>(s))
+                break;
+            s = t;
+            if (slots[s].value != NONE) {
+                best = j - i + 1;
+                value = slots[s].value;
+            }
+        }
+        return best;
+    }
+
+    size_t memory_bytes() const {
+        return slots.size() * sizeof(Slot);
+    }
+};
+
+// Operation of a lowered program. Built-in actions become plain tags,
+// any other action is kept as an index of a virtual one to call, CALL
+// runs another subprogram and REPEAT runs one many times.
+enum class OpCode : uint8_t {
+    FORWARD, BACKWARD, ROTATE_LEFT, ROTATE_RIGHT, UNTIL_UNSAFE, CUSTOM,
+    CALL, REPEAT
+};
+
+struct Op {
+    OpCode code;
+    uint32_t arg;
+
+    auto operator<=>(const Op &) const = default;
+};
+
+// What a subprogram does when started at (0, 0) heading north: where it
+// ends, how much it turns, how many moves it makes and which fields it
+// enters (the footprint, kept only while it is small).
+struct Summary {
+    constexpr static size_t FOOTPRINT_LIMIT = 64;
+    constexpr static uint64_t MOVES_LIMIT = UINT64_MAX / 2;
+
+    coordinate_t dx = 0, dy = 0;
+    int turns = 0;
+    uint64_t moves = 0;
+    // Whether the rover rotates at all, even when the turns cancel out.
+    bool rotates = false;
+    // False when a custom action or a move depending on the sensors
+    // makes the effect unknown.
+    bool known = true;
+    bool footprint_known = true;
+    std::vector<std::pair<coordinate_t, coordinate_t>> footprint;
+
+    void enter(coordinate_t x, coordinate_t y) {
+        if (!footprint_known)
+            return;
+        auto cell = std::make_pair(x, y);
+        auto it = std::lower_bound(footprint.begin(), footprint.end(), cell);
+        if (it != footprint.end() && *it == cell)
+            return;
+        if (footprint.size() == FOOTPRINT_LIMIT) {
+            forget_footprint();
+            return;
+        }
+        footprint.insert(it, cell);
+    }
+
+    void forget_footprint() {
+        footprint_known = false;
+        footprint.clear();
+    }
+
+    void move(bool forward) {
+        auto d = static_cast<Direction>(forward ? turns : (turns + 2) % 4);
+        dx = wrapping_add(dx, DirectionManager::get_dx(d));
+        dy = wrapping_add(dy, DirectionManager::get_dy(d));
+        enter(dx, dy);
+        moves = std::min(moves + 1, MOVES_LIMIT);
+    }
+
+    void turn(int right_turns) {
+        turns = (turns + right_turns) % 4;
+        rotates = true;
+    }
+
+    void unknown() {
+        known = false;
+        forget_footprint();
+    }
+
+    // Appends what next does, started where this summary ends.
+    void then(const Summary &next) {
+        auto d = static_cast<Direction>(turns);
+        known &= next.known;
+        if (!next.footprint_known)
+            forget_footprint();
+        for (const auto &[x, y] : next.footprint) {
+            Coordinates c = DirectionManager::rotate(x, y, d);
+            enter(wrapping_add(dx, c.get_x()), wrapping_add(dy, c.get_y()));
+        }
+        Coordinates c = DirectionManager::rotate(next.dx, next.dy, d);
+        dx = wrapping_add(dx, c.get_x());
+        dy = wrapping_add(dy, c.get_y());
+        turns = (turns + next.turns) % 4;
+        rotates |= next.rotates;
+        moves = std::min(moves + next.moves, MOVES_LIMIT);
+        if (!known)
+            forget_footprint();
+    }
+
+    // Whether checking the footprint costs fewer probes than the moves.
+    bool worth_skipping() const {
+        return known && footprint_known && footprint.size() < moves;
+    }
+};
+
+// Programmed commands lowered to a closed set of operations stored
+// contiguously. Composes form a DAG of subprograms: the same Compose, or
+// structurally identical ones, are lowered once, small ones are inlined
+// into their parents and larger ones are called. Running a command is a
+// loop switching on tags with an explicit stack, with no virtual calls
+// for the built-in actions and no recursion however deep the nesting.
+//
+// A subprogram with a summary is not stepped through when its footprint,
+// placed at the rover, is all safe: the rover jumps to where it would end.
+// Repeats never expand their body: repeated rotations are one turn,
+// repeated moves one segment query and other bodies are jumped over a
+// whole period (one to four repetitions, until the heading is back) at a
+// time using the period's summary.
+class Program {
+private:
+    constexpr static size_t NAMES = 256;
+    constexpr static uint32_t NONE = UINT32_MAX;
+    // Composes of at most that many operations are inlined.
+    constexpr static size_t INLINE_LIMIT = 16;
+    // Commands run that many times in a row or fewer are not worth
+    // summarizing the repetition of.
+    constexpr static uint64_t SHORT_REPEAT = 8;
+
+    struct Subprogram {
+        uint32_t begin, end;
+        // Whether the body is one operation other than CALL and REPEAT,
+        // run without stepping through it.
+        bool single;
+        // Whether the summary is worth checking before stepping through.
+        bool skippable;
+        Summary summary;
+    };
+
+    struct Repetition {
+        uint32_t sub;
+        uint64_t times;
+        // Number of repetitions after which the heading is back.
+        uint32_t period_length;
+        Summary period;
+        Summary whole;
+    };
+
+    std::vector<Op> ops;
+    std::vector<Subprogram> subprograms;
+    std::vector<Repetition> repetitions;
+    std::vector<std::shared_ptr<Action>> customs;
+    std::array<uint32_t, NAMES> table;
+    // The set of programmed names as a bitmap split by nibbles: bit h % 8
+    // of name_rows[h / 8][l] is set when name 16 * h + l is programmed.
+    alignas(16) std::array<std::array<uint8_t, 16>, 2> name_rows{};
+    TokenTrie tokens;
+
+    std::map<const Action *, uint32_t> lowered;
+    std::map<std::vector<Op>, uint32_t> interned;
+    std::map<std::pair<uint32_t, uint64_t>, uint32_t> repeated;
+
+    static size_t index(command_name_t name) {
+        return static_cast<unsigned char>(name);
+    }
+
+    // Only exact types are lowered: a subclass may override execute.
+    static bool is_compose(const Action &a) {
+        return typeid(a) == typeid(Compose);
+    }
+
+    static bool is_repeat(const Action &a) {
+        return typeid(a) == typeid(Repeat);
+    }
+
+    void append_primitive(std::vector<Op> &body,
+                          const std::shared_ptr<Action> &action) {
+        const Action &a = *action;
+        if (typeid(a) == typeid(MoveForward))
+            body.push_back({OpCode::FORWARD, 0});
+        else if (typeid(a) == typeid(MoveBackward))
+            body.push_back({OpCode::BACKWARD, 0});
+        else if (typeid(a) == typeid(RotateLeft))
+            body.push_back({OpCode::ROTATE_LEFT, 0});
+        else if (typeid(a) == typeid(RotateRight))
+            body.push_back({OpCode::ROTATE_RIGHT, 0});
+        else if (typeid(a) == typeid(MoveUntilUnsafe))
+            body.push_back({OpCode::UNTIL_UNSAFE, static_cast<uint32_t>(
+                    static_cast<const MoveUntilUnsafe &>(a).limit())});
+        else {
+            body.push_back({OpCode::CUSTOM,
+                            static_cast<uint32_t>(customs.size())});
+            customs.push_back(action);
+        }
+    }
+
+    void append_call(std::vector<Op> &body, uint32_t sub) const {
+        const Subprogram &callee = subprograms[sub];
+        if (callee.end - callee.begin <= INLINE_LIMIT)
+            body.insert(body.end(), ops.begin() + callee.begin,
+                        ops.begin() + callee.end);
+        else
+            body.push_back({OpCode::CALL, sub});
+    }
+
+    static coordinate_t wrapping_mul(coordinate_t c, uint64_t times) {
+        return static_cast<coordinate_t>(
+                static_cast<uint32_t>(times) * static_cast<uint32_t>(c));
+    }
+
+    // Summary of running each times times in a row.
+    static Summary repeat_summary(const Summary &each, const Summary &period,
+                                  uint32_t period_length, uint64_t times) {
+        uint64_t periods = times / period_length;
+        uint64_t rest = times % period_length;
+        Summary result;
+        if (periods > 0 && period.dx == 0 && period.dy == 0) {
+            // The rover comes back every period, so the first one enters
+            // every field there is.
+            for (uint64_t i = 0; i < rest; ++i)
+                result.then(each);
+            result.known = each.known;
+            result.footprint_known = period.footprint_known;
+            result.footprint = period.footprint;
+            bool overflow = each.moves != 0 &&
+                    times > Summary::MOVES_LIMIT / each.moves;
+            result.moves = overflow ? Summary::MOVES_LIMIT
+                                    : times * each.moves;
+            return result;
+        }
+        // Every period enters a new field, so the footprint outgrows its
+        // limit after a few; the other periods are added in closed form.
+        uint64_t done = 0;
+        for (; done < periods && result.footprint_known; ++done)
+            result.then(period);
+        if (done < periods) {
+            uint64_t left = periods - done;
+            result.dx = wrapping_add(result.dx, wrapping_mul(period.dx, left));
+            result.dy = wrapping_add(result.dy, wrapping_mul(period.dy, left));
+            bool overflow = period.moves != 0 &&
+                    left > Summary::MOVES_LIMIT / period.moves;
+            result.moves = overflow ? Summary::MOVES_LIMIT
+                    : std::min(result.moves + left * period.moves,
+                               Summary::MOVES_LIMIT);
+            result.known &= period.known;
+        }
+        for (uint64_t i = 0; i < rest; ++i)
+            result.then(each);
+        return result;
+    }
+
+    Repetition make_repetition(uint32_t sub, uint64_t times) const {
+        const Summary &each = subprograms[sub].summary;
+        uint32_t period_length = each.turns == 0 ? 1
+                               : each.turns == 2 ? 2 : 4;
+        Summary period;
+        for (uint32_t i = 0; i < period_length; ++i)
+            period.then(each);
+        Summary whole = repeat_summary(each, period, period_length, times);
+        whole.rotates = times > 0 && each.rotates;
+        return {sub, times, period_length, std::move(period),
+                std::move(whole)};
+    }
+
+    uint32_t repetition(uint32_t sub, uint64_t times) {
+        auto key = std::make_pair(sub, times);
+        if (auto it = repeated.find(key); it != repeated.end())
+            return it->second;
+        auto index = static_cast<uint32_t>(repetitions.size());
+        repetitions.push_back(make_repetition(sub, times));
+        repeated.emplace(key, index);
+        return index;
+    }
+
+    Summary summarize(const std::vector<Op> &body) const {
+        Summary summary;
+        for (const Op &op : body) {
+            switch (op.code) {
+                case OpCode::FORWARD:
+                case OpCode::BACKWARD:
+                    summary.move(op.code == OpCode::FORWARD);
+                    break;
+                case OpCode::ROTATE_LEFT:
+                    summary.turn(3);
+                    break;
+                case OpCode::ROTATE_RIGHT:
+                    summary.turn(1);
+                    break;
+                case OpCode::UNTIL_UNSAFE:
+                case OpCode::CUSTOM:
+                    summary.unknown();
+                    break;
+                case OpCode::CALL:
+                    summary.then(subprograms[op.arg].summary);
+                    break;
+                case OpCode::REPEAT:
+                    summary.then(repetitions[op.arg].whole);
+                    break;
+            }
+        }
+        return summary;
+    }
+
+    // Structurally identical bodies share one subprogram.
+    uint32_t intern(std::vector<Op> body) {
+        auto it = interned.find(body);
+        if (it != interned.end())
+            return it->second;
+        auto sub = static_cast<uint32_t>(subprograms.size());
+        Summary summary = summarize(body);
+        bool single = body.size() == 1 && body[0].code < OpCode::CALL;
+        bool skippable = summary.worth_skipping();
+        Subprogram subprogram{static_cast<uint32_t>(ops.size()), 0, single,
+                              skippable, std::move(summary)};
+        ops.insert(ops.end(), body.begin(), body.end());
+        subprogram.end = static_cast<uint32_t>(ops.size());
+        subprograms.push_back(std::move(subprogram));
+        interned.emplace(std::move(body), sub);
+        return sub;
+    }
+
+    // Lowers an action into a subprogram, iterating over nested Composes
+    // and Repeats with an explicit stack.
+    uint32_t lower(const std::shared_ptr<Action> &action) {
+        struct Frame {
+            const Action *node;
+            const std::shared_ptr<Action> *children;
+            size_t count, next;
+            std::vector<Op> body;
+        };
+        auto open = [](const Action &node) {
+            if (is_compose(node)) {
+                const auto &children =
+                        static_cast<const Compose &>(node).actions();
+                return Frame{&node, children.data(), children.size(), 0, {}};
+            }
+            return Frame{&node, &static_cast<const Repeat &>(node).action(),
+                         1, 0, {}};
+        };
+        // A finished child of a frame: called or inlined by a Compose,
+        // becoming the body of a Repeat.
+        auto add_child = [&](Frame &frame, uint32_t sub) {
+            if (is_compose(*frame.node)) {
+                append_call(frame.body, sub);
+            }
+            else {
+                uint64_t times = static_cast<const Repeat *>(frame.node)->times();
+                frame.body = {{OpCode::REPEAT, repetition(sub, times)}};
+            }
+        };
+
+        if (!is_compose(*action) && !is_repeat(*action)) {
+            std::vector<Op> body;
+            append_primitive(body, action);
+            return intern(std::move(body));
+        }
+        if (auto it = lowered.find(action.get()); it != lowered.end())
+            return it->second;
+
+        std::vector<Frame> stack;
+        uint32_t result = NONE;
+        stack.push_back(open(*action));
+        while (!stack.empty()) {
+            Frame &frame = stack.back();
+            if (frame.next == frame.count) {
+                uint32_t sub = intern(std::move(frame.body));
+                lowered.emplace(frame.node, sub);
+                stack.pop_back();
+                if (stack.empty())
+                    result = sub;
+                else
+                    add_child(stack.back(), sub);
+                continue;
+            }
+            const auto &child = frame.children[frame.next++];
+            if (is_compose(*child) || is_repeat(*child)) {
+                if (auto it = lowered.find(child.get()); it != lowered.end())
+                    add_child(frame, it->second);
+                else
+                    stack.push_back(open(*child));
+            }
+            else if (is_compose(*frame.node)) {
+                append_primitive(frame.body, child);
+            }
+            else {
+                std::vector<Op> body;
+                append_primitive(body, child);
+                add_child(frame, intern(std::move(body)));
+            }
+        }
+        return result;
+    }
+
+    // Checks the summary's footprint placed at the rover and, when it is
+    // all safe, moves the rover to where the subprogram would end.
+    template <class Probe>
+    static bool skip(const Summary &summary, Position &p, Probe &probe) {
+        const Coordinates &at = p.get_coordinates();
+        Direction d = p.get_direction();
+        for (const auto &[lx, ly] : summary.footprint) {
+            Coordinates c = DirectionManager::rotate(lx, ly, d);
+            if (!probe.is_safe(wrapping_add(at.get_x(), c.get_x()),
+                               wrapping_add(at.get_y(), c.get_y())))
+                return false;
+        }
+        Coordinates c = DirectionManager::rotate(summary.dx, summary.dy, d);
+        Coordinates end = at;
+        end += c;
+        Direction heading = static_cast<Direction>(
+                (static_cast<int>(d) + summary.turns) % 4);
+        p = {end, heading};
+        return true;
+    }
+
+    // Runs an operation other than CALL and REPEAT. Returns false when
+    // the rover has to stop.
+    template <class Probe>
+    bool step(const Op &op, Position &p, Probe &probe,
+              const sensors_t &sensors) const {
+        switch (op.code) {
+            case OpCode::FORWARD:
+            case OpCode::BACKWARD: {
+                Position new_position = p;
+                if (op.code == OpCode::FORWARD)
+                    new_position.go_forward();
+                else
+                    new_position.go_backward();
+                const Coordinates &c = new_position.get_coordinates();
+                if (!probe.is_safe(c.get_x(), c.get_y()))
+                    return false;
+                p = new_position;
+                break;
+            }
+            case OpCode::ROTATE_LEFT:
+                p.turn_left();
+                break;
+            case OpCode::ROTATE_RIGHT:
+                p.turn_right();
+                break;
+            case OpCode::UNTIL_UNSAFE: {
+                const Coordinates &c = p.get_coordinates();
+                p.go_forward(until_unsafe_run(
+                        probe, c.get_x(), c.get_y(), p.get_direction(),
+                        static_cast<coordinate_t>(op.arg)));
+                break;
+            }
+            case OpCode::CUSTOM:
+                customs[op.arg]->execute(p, sensors);
+                break;
+            case OpCode::CALL:
+            case OpCode::REPEAT:
+                break;
+        }
+        return true;
+    }
+
+    // Repeated single move: one segment query per sensor. Returns false
+    // when the rover stops before making all the moves.
+    template <class Probe>
+    static bool run_straight(bool forward, uint64_t times, Position &p,
+                             Probe &probe) {
+        Direction heading = p.get_direction();
+        Direction d = forward ? heading
+                              : DirectionManager::get_opposite(heading);
+        coordinate_t dx = DirectionManager::get_dx(d);
+        coordinate_t dy = DirectionManager::get_dy(d);
+        while (times > 0) {
+            auto limit = static_cast<coordinate_t>(
+                    std::min<uint64_t>(times, INT32_MAX));
+            const Coordinates &at = p.get_coordinates();
+            coordinate_t x = at.get_x(), y = at.get_y();
+            coordinate_t steps = probe.safe_run(x, y, d, limit);
+            Coordinates end = at;
+            end += {dx * steps, dy * steps};
+            p = {end, heading};
+            if (steps < limit) {
+                // Segment queries also end at the edge of the coordinate
+                // range, while single moves wrap around it. The next field
+                // is asked about on its own, so the probe knows why the
+                // rover stops.
+                end += {dx, dy};
+                if (!probe.is_safe(end.get_x(), end.get_y()) ||
+                        steps < std::min(DirectionManager::room(x, dx),
+                                         DirectionManager::room(y, dy)))
+                    return false;
+                p = {end, heading};
+                ++steps;
+            }
+            times -= static_cast<uint64_t>(steps);
+        }
+        return true;
+    }
+
+    // Runs as much of a repetition as can be done without stepping
+    // through its body; left is set to the number of repetitions still
+    // to step through. Returns false when the rover has to stop.
+    template <class Probe>
+    bool jump(const Repetition &r, Position &p, Probe &probe,
+              uint64_t &left) const {
+        const Subprogram &body = subprograms[r.sub];
+        const Summary &each = body.summary;
+        left = 0;
+        if (r.times == 0)
+            return true;
+        if (each.known && each.moves == 0) {
+            for (uint64_t i = 0; i < r.times % 4; ++i)
+                for (int t = 0; t < each.turns; ++t)
+                    p.turn_right();
+            return true;
+        }
+        if (body.end - body.begin == 1 &&
+                (ops[body.begin].code == OpCode::FORWARD ||
+                 ops[body.begin].code == OpCode::BACKWARD)) {
+            bool forward = ops[body.begin].code == OpCode::FORWARD;
+            return run_straight(forward, r.times, p, probe);
+        }
+        if (r.whole.worth_skipping() && skip(r.whole, p, probe))
+            return true;
+        uint64_t done = 0;
+        if (r.period.worth_skipping()) {
+            while (r.times - done >= r.period_length &&
+                    skip(r.period, p, probe))
+                done += r.period_length;
+        }
+        left = r.times - done;
+        return true;
+    }
+
+public:
+    Program(const commands_t &commands,
+            const command_tokens_t &command_tokens = {}) {
+        table.fill(NONE);
+        for (const auto &[name, action] : commands) {
+            size_t i = index(name);
+            table[i] = lower(action);
+            name_rows[i / 128][i % 16] |= uint8_t{1} << (i / 16 % 8);
+        }
+        // Without longer tokens, commands are looked up in the table.
+        if (!command_tokens.empty()) {
+            std::vector<std::pair<std::string, uint32_t>> all;
+            for (const auto &[name, action] : commands)
+                all.emplace_back(std::string(1, name), table[index(name)]);
+            for (const auto &[token, action] : command_tokens) {
+                if (!token.empty())
+                    all.emplace_back(token, lower(action));
+            }
+            tokens = TokenTrie(all);
+        }
+        lowered.clear();
+        interned.clear();
+        repeated.clear();
+    }
+
+    bool programmed(command_name_t name) const {
+        return table[index(name)] != NONE;
+    }
+
+    // Length of the command the list has at position i, 0 when it is not
+    // programmed. The longest programmed token is taken; it can be run
+    // with run_command.
+    size_t match(std::string_view commands, size_t i,
+                 uint32_t &command) const {
+        if (!tokens.empty())
+            return tokens.match(commands, i, command);
+        command = table[index(commands[i])];
+        return command != NONE;
+    }
+
+    // Index of the first command of the list that is not programmed, or
+    // its length when all are. Sixteen commands are checked at a time
+    // with nibble table lookups when SSSE3 is available, eight at a time
+    // without branching on each one otherwise.
+    size_t first_unknown(std::string_view commands) const {
+        size_t i = 0, n = commands.size();
+        if (!tokens.empty()) {
+            uint32_t command;
+            while (i < n) {
+                size_t length = tokens.match(commands, i, command);
+                if (length == 0)
+                    break;
+                i += length;
+            }
+            return i;
+        }
+#ifdef __SSSE3__
+        const __m128i low_rows = _mm_load_si128(
+                reinterpret_cast<const __m128i *>(name_rows[0].data()));
+        const __m128i high_rows = _mm_load_si128(
+                reinterpret_cast<const __m128i *>(name_rows[1].data()));
+        const __m128i bits = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128,
+                                           1, 2, 4, 8, 16, 32, 64, -128);
+        const __m128i nibble = _mm_set1_epi8(0x0F);
+        for (; i + 16 <= n; i += 16) {
+            __m128i v = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i *>(commands.data() + i));
+            __m128i low = _mm_and_si128(v, nibble);
+            __m128i high = _mm_and_si128(_mm_srli_epi16(v, 4), nibble);
+            __m128i upper = _mm_cmpgt_epi8(high, _mm_set1_epi8(7));
+            __m128i row = _mm_or_si128(
+                    _mm_and_si128(upper, _mm_shuffle_epi8(high_rows, low)),
+                    _mm_andnot_si128(upper, _mm_shuffle_epi8(low_rows, low)));
+            __m128i bit = _mm_shuffle_epi8(bits, high);
+            __m128i found = _mm_cmpeq_epi8(_mm_and_si128(row, bit), bit);
+            unsigned missing = ~_mm_movemask_epi8(found) & 0xFFFFu;
+            if (missing != 0)
+                return i + std::countr_zero(missing);
+        }
+#endif
+        for (; i + 8 <= n; i += 8) {
+            bool all = true;
+            for (size_t j = i; j < i + 8; ++j)
+                all &= programmed(commands[j]);
+            if (!all)
+                break;
+        }
+        while (i < n && programmed(commands[i]))
+            ++i;
+        return i;
+    }
+
+    // Upper bound of how far a command can take the rover along either
+    // axis; UINT64_MAX when it depends on the sensors or custom actions.
+    uint64_t reach(uint32_t command) const {
+        const Summary &summary = subprograms[command].summary;
+        return summary.known ? summary.moves : UINT64_MAX;
+    }
+
+    // Whether a command only turns the rover, whatever the sensors say;
+    // turns is set to the number of right turns it makes.
+    bool only_turns(uint32_t command, int &turns) const {
+        const Summary &summary = subprograms[command].summary;
+        turns = summary.turns;
+        return summary.known && summary.moves == 0;
+    }
+
+    // Whether a command only moves the rover straight ahead or straight
+    // back, never rotating, at most INT32_MAX fields until one is
+    // dangerous; steps is set to the fields, negative when going back.
+    // Moves without rotations adding up to a displacement as long as the
+    // walk all go the same way.
+    bool only_straight(uint32_t command, int64_t &steps) const {
+        const Summary &summary = subprograms[command].summary;
+        steps = summary.dy;
+        return summary.known && !summary.rotates && summary.dx == 0 &&
+               summary.moves > 0 && summary.moves <= INT32_MAX &&
+               static_cast<uint64_t>(steps < 0 ? -steps : steps) ==
+                       summary.moves;
+    }
+
+    // Whether some command is named by a token longer than a character.
+    bool has_tokens() const {
+        return !tokens.empty();
+    }
+
+    // Whether some command needs the virtual escape hatch.
+    bool has_custom() const {
+        return !customs.empty();
+    }
+
+    // Runs a programmed command, asking the probe about the fields
+    // entered. Returns false, leaving the rover on the last safe field,
+    // when it is heading towards a dangerous one. Custom actions get the
+    // sensors and may throw DangerousField instead.
+    template <class Probe>
+    bool run(command_name_t name, Position &p, Probe &probe,
+             const sensors_t &sensors) const {
+        return run_command(table[index(name)], p, probe, sensors);
+    }
+
+    // Same for a command found by match, run the given number of times
+    // in a row as if it was repeated.
+    template <class Probe>
+    bool run_command(uint32_t matched, Position &p, Probe &probe,
+                     const sensors_t &sensors, uint64_t times = 1) const {
+        const Subprogram &command = subprograms[matched];
+        // Most commands are a single move or turn.
+        if (times == 1 && command.single)
+            return step(ops[command.begin], p, probe, sensors);
+        if (times != 1 && times <= SHORT_REPEAT) {
+            for (; times > 0; --times) {
+                if (!run_command(matched, p, probe, sensors))
+                    return false;
+            }
+            return true;
+        }
+        if (times != 1) {
+            if (!jump(make_repetition(matched, times), p, probe, times))
+                return false;
+            if (times == 0)
+                return true;
+        }
+        else if (command.skippable && skip(command.summary, p, probe)) {
+            return true;
+        }
+
+        // A frame runs ops [begin, end) again `again` more times.
+        struct Frame {
+            uint32_t pc, begin, end;
+            uint64_t again;
+        };
+        // Most programs never nest deeper than that.
+        constexpr size_t INITIAL_DEPTH = 16;
+        std::vector<Frame> stack;
+        Frame frame{command.begin, command.begin, command.end, times - 1};
+        // Probes may be told about the composed bodies stepped through.
+        constexpr bool told = requires(uint32_t sub, uint64_t n) {
+            probe.compose_begin(sub, n);
+            probe.compose_end();
+        };
+        auto enter = [&](uint32_t sub, uint64_t times) {
+            const Subprogram &callee = subprograms[sub];
+            if (stack.capacity() == 0)
+                stack.reserve(INITIAL_DEPTH);
+            stack.push_back(frame);
+            frame = {callee.begin, callee.begin, callee.end, times - 1};
+            if constexpr (told)
+                probe.compose_begin(sub, times);
+        };
+        auto stop = [&] {
+            if constexpr (told) {
+                for (size_t i = 0; i < stack.size(); ++i)
+                    probe.compose_end();
+            }
+            return false;
+        };
+        while (true) {
+            if (frame.pc == frame.end) {
+                if (frame.again > 0) {
+                    --frame.again;
+                    frame.pc = frame.begin;
+                    continue;
+                }
+                if (stack.empty())
+                    return true;
+                frame = stack.back();
+                stack.pop_back();
+                if constexpr (told)
+                    probe.compose_end();
+                continue;
+            }
+            const Op &op = ops[frame.pc++];
+            if (op.code == OpCode::CALL) {
+                const Subprogram &callee = subprograms[op.arg];
+                if (!callee.skippable || !skip(callee.summary, p, probe))
+                    enter(op.arg, 1);
+            }
+            else if (op.code == OpCode::REPEAT) {
+                const Repetition &r = repetitions[op.arg];
+                uint64_t left;
+                if (!jump(r, p, probe, left))
+                    return stop();
+                if (left > 0)
+                    enter(r.sub, left);
+            }
+            else if (!step(op, p, probe, sensors)) {
+                return stop();
+            }
+        }
+    }
+
+    bool run(command_name_t name, Position &p,
+             const sensors_t &sensors) const {
+        SensorListProbe probe(sensors);
+        return run(name, p, probe, sensors);
+    }
+};
+
+// Command list compiled ahead of time (see static_program.h). Running it
+// asks a probe about the fields entered and returns false when the rover
+// has to stop.
+template <class P>
+concept CompiledCommands = requires(Position &p, SensorListProbe &probe) {
+    { P::run(p, probe) } -> std::same_as<bool>;
+};
+
+// Command list kept in a form other than text (see binary_commands.h).
+// It is run through the rover's program and returns false when the rover
+// has to stop.
+template <class C>
+concept RecordedCommands = requires(const C &commands, const Program &program,
+                                    Position &p, SensorListProbe &probe,
+                                    const sensors_t &sensors) {
+    { commands.run(program, p, probe, sensors) } -> std::same_as<bool>;
+};
+
+// Adapter showing a sensor held by value to virtual actions.
+template <class S>
+class SensorView : public Sensor {
+private:
+    S *sensor;
+public:
+    SensorView(S *sensor) : sensor(sensor) {}
+
+    bool is_safe(coordinate_t x, coordinate_t y) override {
+        return sensors_are_safe(*sensor, x, y);
+    }
+
+    coordinate_t safe_run(coordinate_t x, coordinate_t y, Direction d,
+                          coordinate_t limit) override {
+        return sensors_safe_run(*sensor, x, y, d, limit);
+    }
+};
+
+// What a rover does at the edge of its coordinate range.
+enum class Overflow {
+    // Coordinates wrap around to the other edge.
+    WRAP,
+    // The edge is dangerous: the rover stops before crossing it.
+    STOP
+};
+
+// Why a rover stopped during its last command list.
+enum class StopReason {
+    NONE,
+    DANGEROUS_FIELD,
+    UNKNOWN_COMMAND,
+    OUT_OF_RANGE
+};
+
+// Observer of what a rover does, called from its execute loop. This one
+// ignores everything; rovers whose policy keeps it have no hooks left
+// after inlining. Observers with enabled set are also told about every
+// sensor asked, with the sensor's index in the order the rover was
+// given its sensors, every sensor of a sensors_t counted on its own.
+struct NullObserver {
+    constexpr static bool enabled = false;
+
+    void on_land([[maybe_unused]] const Position &p) {}
+    void on_execute_begin([[maybe_unused]] const Position &p) {}
+    // A command of a text list about to run, named by its token.
+    void on_dispatch([[maybe_unused]] std::string_view command) {}
+    // The body of a composed command nested in the one running is stepped
+    // through times times in a row, until the matching on_compose_end.
+    // Bodies jumped over using their summary are not.
+    void on_compose_begin([[maybe_unused]] uint32_t body,
+                          [[maybe_unused]] uint64_t times) {}
+    void on_compose_end() {}
+    // A sensor is about to be asked; on_probe or on_run follows.
+    void on_probe_begin([[maybe_unused]] size_t sensor) {}
+    void on_probe([[maybe_unused]] size_t sensor,
+                  [[maybe_unused]] coordinate_t x,
+                  [[maybe_unused]] coordinate_t y,
+                  [[maybe_unused]] bool safe) {}
+    // A segment query: free of the limit fields towards d are safe.
+    void on_run([[maybe_unused]] size_t sensor,
+                [[maybe_unused]] coordinate_t x,
+                [[maybe_unused]] coordinate_t y,
+                [[maybe_unused]] Direction d,
+                [[maybe_unused]] coordinate_t limit,
+                [[maybe_unused]] coordinate_t free) {}
+    void on_stop([[maybe_unused]] const Position &p,
+                 [[maybe_unused]] StopReason reason) {}
+    void on_execute_end([[maybe_unused]] const Position &p,
+                        [[maybe_unused]] StopReason reason) {}
+};
+
+// Compile-time knobs of a rover. Policies derive from it and override
+// what they change.
+struct DefaultRoverPolicy {
+    // Type of the coordinates a rover keeps, coordinate_t or narrower.
+    // A narrower rover lands only inside its range and stops at its edge
+    // whatever the overflow policy.
+    using coordinate_type = coordinate_t;
+    constexpr static Overflow overflow = Overflow::WRAP;
+    using observer_type = NullObserver;
+};
+
+// Rover with a statically typed set of sensors held by value. Every
+// field entered is checked with a fold over the sensors, so calls to
+// sensors of final types are inlined into the move loop. A sensors_t
+// member stands for a run-time list of type-erased sensors.
+template <class Policy, class... Sensors>
+class PolicyRover {
+private:
+    using coordinate_type = typename Policy::coordinate_type;
+    constexpr static bool NARROW = !std::same_as<coordinate_type, coordinate_t>;
+    // Whether the rover stops at the edge of its range.
+    constexpr static bool RANGED = NARROW || Policy::overflow == Overflow::STOP;
+    // Stopping at the edge of coordinate_t itself, the rover keeps off
+    // the outermost fields, so that no step can wrap around.
+    using Range = CoordinateRange<coordinate_type, NARROW ? 0 : 1>;
+    using observer_type = typename Policy::observer_type;
+
     bool landed = false;
-    bool stopped = false;
-    Position position;
-    commands_t commands;
-    sensors_t sensors;
+    StopReason stop = StopReason::NONE;
+    BasicPosition<coordinate_type> position;
+    Program program;
+    std::tuple<Sensors...> sensors;
+    [[no_unique_address]] observer_type _observer;
+
+    // A sensor shown to virtual actions, reporting to the observer.
+    class ObservedSensor : public Sensor {
+    private:
+        std::shared_ptr<Sensor> sensor;
+        observer_type *observer;
+        size_t index;
+    public:
+        ObservedSensor(std::shared_ptr<Sensor> sensor,
+                       observer_type *observer, size_t index) :
+            sensor(std::move(sensor)), observer(observer), index(index) {}
+
+        bool is_safe(coordinate_t x, coordinate_t y) override {
+            observer->on_probe_begin(index);
+            bool safe = sensor->is_safe(x, y);
+            observer->on_probe(index, x, y, safe);
+            return safe;
+        }
+
+        coordinate_t safe_run(coordinate_t x, coordinate_t y, Direction d,
+                              coordinate_t limit) override {
+            observer->on_probe_begin(index);
+            coordinate_t free = sensor->safe_run(x, y, d, limit);
+            observer->on_run(index, x, y, d, limit, free);
+            return free;
+        }
+    };
+
+    // Questions the interpreter asks about fields, answered by folding
+    // over all the sensors. A checked probe also refuses fields out of
+    // range; it is only needed near the edge.
+    template <bool checked>
+    class Probe {
+    private:
+        PolicyRover &rover;
+
+        // Sensor by sensor, telling the observer; index counts the
+        // sensors asked so far.
+        template <class S>
+        bool observed_is_safe(S &sensor, size_t &index, coordinate_t x,
+                              coordinate_t y) {
+            if constexpr (std::same_as<S, sensors_t>) {
+                for (auto &each : sensor) {
+                    if (!observed_is_safe(each, index, x, y))
+                        return false;
+                }
+                return true;
+            }
+            else {
+                rover._observer.on_probe_begin(index);
+                bool safe = sensors_are_safe(sensor, x, y);
+                rover._observer.on_probe(index++, x, y, safe);
+                return safe;
+            }
+        }
+
+        template <class S>
+        coordinate_t observed_safe_run(S &sensor, size_t &index,
+                                       coordinate_t x, coordinate_t y,
+                                       Direction d, coordinate_t limit) {
+            if constexpr (std::same_as<S, sensors_t>) {
+                for (auto &each : sensor) {
+                    if (limit == 0)
+                        break;
+                    limit = observed_safe_run(each, index, x, y, d, limit);
+                }
+                return limit;
+            }
+            else {
+                rover._observer.on_probe_begin(index);
+                coordinate_t free = sensors_safe_run(sensor, x, y, d, limit);
+                rover._observer.on_run(index++, x, y, d, limit, free);
+                return free;
+            }
+        }
+
+    public:
+        // Why the last field asked about was refused, NONE if it was not.
+        // Runs that end early do not count: a run stopping the rover
+        // asks about the field it ends at too.
+        StopReason last = StopReason::NONE;
+
+        Probe(PolicyRover &rover) : rover(rover) {}
+
+        void compose_begin(uint32_t body, uint64_t times) {
+            rover._observer.on_compose_begin(body, times);
+        }
+
+        void compose_end() {
+            rover._observer.on_compose_end();
+        }
+
+        bool is_safe(coordinate_t x, coordinate_t y) {
+            if constexpr (checked) {
+                if (!Range::contains(x, y)) {
+                    last = StopReason::OUT_OF_RANGE;
+                    return false;
+                }
+            }
+            bool safe;
+            if constexpr (observer_type::enabled) {
+                size_t index = 0;
+                safe = std::apply([&](auto &... sensor) {
+                    return (observed_is_safe(sensor, index, x, y) && ...);
+                }, rover.sensors);
+            }
+            else {
+                safe = std::apply([&](auto &... sensor) {
+                    return (sensors_are_safe(sensor, x, y) && ...);
+                }, rover.sensors);
+            }
+            last = safe ? StopReason::NONE : StopReason::DANGEROUS_FIELD;
+            return safe;
+        }
+
+        coordinate_t safe_run(coordinate_t x, coordinate_t y, Direction d,
+                              coordinate_t limit) {
+            if constexpr (checked)
+                limit = Range::clamp_run(x, y, d, limit);
+            if constexpr (observer_type::enabled) {
+                size_t index = 0;
+                std::apply([&](auto &... sensor) {
+                    ((limit = limit == 0 ? 0
+                            : observed_safe_run(sensor, index, x, y, d,
+                                                limit)), ...);
+                }, rover.sensors);
+            }
+            else {
+                std::apply([&](auto &... sensor) {
+                    ((limit = limit == 0 ? 0
+                            : sensors_safe_run(sensor, x, y, d, limit)), ...);
+                }, rover.sensors);
+            }
+            return limit;
+        }
+    };
+
+    static void append(sensors_t &erased, sensors_t &sensors) {
+        erased.insert(erased.end(), sensors.begin(), sensors.end());
+    }
+
+    template <class S>
+    static void append(sensors_t &erased, S &sensor) {
+        erased.push_back(std::make_shared<SensorView<S>>(&sensor));
+    }
+
+    // The range as a sensor of virtual actions, remembering whether it
+    // refused the last field it was asked about.
+    class RangeSensor : public Range {
+    public:
+        bool refused = false;
+
+        bool is_safe(coordinate_t x, coordinate_t y) override {
+            refused = !Range::is_safe(x, y);
+            return !refused;
+        }
+    };
+
+    // Sensors as seen by virtual actions. The range comes first, so when
+    // an action throws DangerousField it tells whether the field was out
+    // of range.
+    sensors_t erase(std::shared_ptr<RangeSensor> &range) {
+        sensors_t erased;
+        if constexpr (RANGED) {
+            range = std::make_shared<RangeSensor>();
+            erased.push_back(range);
+        }
+        std::apply([&](auto &... sensor) {
+            (append(erased, sensor), ...);
+        }, sensors);
+        if constexpr (observer_type::enabled) {
+            size_t first = RANGED ? 1 : 0;
+            for (size_t i = first; i < erased.size(); ++i) {
+                erased[i] = std::make_shared<ObservedSensor>(
+                        std::move(erased[i]), &_observer, i - first);
+            }
+        }
+        return erased;
+    }
+
+    // Commands run on a position of coordinate_t; a narrower one is
+    // widened for the run and stored back after it.
+    template <class Run>
+    void drive(Run run) {
+        if constexpr (NARROW) {
+            Position wide = convert_position<coordinate_t>(position);
+            run(wide);
+            position = convert_position<coordinate_type>(wide);
+        }
+        else {
+            run(position);
+        }
+    }
+
+    // Whether a command moving the rover by at most reach fields surely
+    // keeps it in range. Checked once per command, so that commands run
+    // away from the edge do not check every field.
+    static bool far_from_edge(const Position &p, uint64_t reach) {
+        if constexpr (!RANGED) {
+            return true;
+        }
+        else {
+            if (reach > INT32_MAX)
+                return false;
+            auto r = static_cast<int64_t>(reach);
+            Coordinates c = p.get_coordinates();
+            return c.get_x() - r >= Range::LOW && c.get_x() + r <= Range::HIGH &&
+                   c.get_y() - r >= Range::LOW && c.get_y() + r <= Range::HIGH;
+        }
+    }
+
+    static StopReason refused(StopReason last) {
+        return last == StopReason::NONE ? StopReason::DANGEROUS_FIELD : last;
+    }
+
+    Position current() const {
+        return convert_position<coordinate_t>(position);
+    }
+
+    void finish() {
+        if (stop != StopReason::NONE)
+            _observer.on_stop(current(), stop);
+        _observer.on_execute_end(current(), stop);
+    }
+
+    static StopReason thrown(const std::shared_ptr<RangeSensor> &range) {
+        return range && range->refused ? StopReason::OUT_OF_RANGE
+                                       : StopReason::DANGEROUS_FIELD;
+    }
+
+    // Runs a command list until the rover stops, setting the reason.
+    void run_list(std::string_view command_list, Position &p,
+                  const sensors_t &erased) {
+        Probe<false> fast(*this);
+        Probe<true> checked(*this);
+        // The rover stops before the first command not programmed.
+        // Single characters are all checked up front, longer tokens
+        // are only matched once, as they come.
+        size_t known = program.has_tokens()
+                       ? command_list.size()
+                       : program.first_unknown(command_list);
+        size_t i = 0;
+        while (i < known) {
+            uint32_t command = 0;
+            size_t length = program.match(command_list, i, command);
+            if (length == 0)
+                break;
+            _observer.on_dispatch(command_list.substr(i, length));
+            i += length;
+            if (far_from_edge(p, program.reach(command))) {
+                if (!program.run_command(command, p, fast, erased)) {
+                    stop = refused(fast.last);
+                    break;
+                }
+            }
+            else if (!program.run_command(command, p, checked, erased)) {
+                stop = refused(checked.last);
+                break;
+            }
+        }
+        if (stop == StopReason::NONE && i < command_list.size())
+            stop = StopReason::UNKNOWN_COMMAND;
+    }
 
 public:
-    Rover(commands_t commands_, sensors_t sensors_) :
+    PolicyRover(const commands_t &commands, Sensors... sensors_) :
+        PolicyRover(commands, command_tokens_t{}, std::move(sensors_)...) {}
+
+    PolicyRover(const commands_t &commands,
+                const command_tokens_t &command_tokens, Sensors... sensors_) :
         // Since the rover hasn't landed yet, the position doesn't matter.
         position({0, 0}, Direction::NORTH),
-        commands(std::move(commands_)),
-        sensors(std::move(sensors_)) {}
+        program(commands, command_tokens),
+        sensors(std::move(sensors_)...) {}
 
-    friend std::ostream& operator<<(std::ostream& os, const Rover &rover) {
+    friend std::ostream& operator<<(std::ostream& os,
+                                    const PolicyRover &rover) {
         if (!rover.landed) {
             os << "unknown";
         }
         else {
             os << rover.position;
-            if (rover.stopped)
+            if (rover.stop != StopReason::NONE)
                 os << " stopped";
         }
         return os;
     }
 
+    StopReason stop_reason() const {
+        return stop;
+    }
+
+    observer_type &observer() {
+        return _observer;
+    }
+
     void execute(std::string command_list) {
         if (landed) {
-            stopped = false;
-            try {
-                for (const auto &command : command_list) {
-                    // Checking if command was programmed.
-                    if (commands.count(command) == 0) {
-                        stopped = true;
-                        break;
-                    }
-                    // Throws exception.
-                    commands[command]->execute(position, sensors);
+            stop = StopReason::NONE;
+            _observer.on_execute_begin(current());
+            drive([&](Position &p) {
+                if (!program.has_custom()) {
+                    run_list(command_list, p, sensors_t{});
+                    return;
                 }
-            }
-            catch (DangerousField& e) {
-                stopped = true;
-            }
+                // Custom actions may throw an exception instead.
+                std::shared_ptr<RangeSensor> range;
+                sensors_t erased = erase(range);
+                try {
+                    run_list(command_list, p, erased);
+                }
+                catch (DangerousField& e) {
+                    stop = thrown(range);
+                }
+            });
+            finish();
         }
         else {
             throw RoverDidNotLand();
         }
     }
 
+    template <CompiledCommands P>
+    void execute(P) {
+        if (!landed)
+            throw RoverDidNotLand();
+        _observer.on_execute_begin(current());
+        Probe<RANGED> probe(*this);
+        drive([&](Position &p) {
+            bool done = P::run(p, probe);
+            stop = done ? StopReason::NONE
+                 : probe.last != StopReason::NONE ? probe.last
+                 : StopReason::UNKNOWN_COMMAND;
+        });
+        finish();
+    }
+
+    template <RecordedCommands C>
+    void execute(const C &commands) {
+        if (!landed)
+            throw RoverDidNotLand();
+        _observer.on_execute_begin(current());
+        Probe<RANGED> probe(*this);
+        auto run = [&](Position &p, const sensors_t &erased) {
+            bool done = commands.run(program, p, probe, erased);
+            stop = done ? StopReason::NONE
+                 : probe.last != StopReason::NONE ? probe.last
+                 : StopReason::UNKNOWN_COMMAND;
+        };
+        drive([&](Position &p) {
+            if (!program.has_custom()) {
+                run(p, sensors_t{});
+                return;
+            }
+            std::shared_ptr<RangeSensor> range;
+            sensors_t erased = erase(range);
+            try {
+                run(p, erased);
+            }
+            catch (DangerousField& e) {
+                stop = thrown(range);
+            }
+        });
+        finish();
+    }
+
+    // Throws CoordinatesOutOfRange when the rover's coordinates cannot
+    // hold the landing field.
     void land(const Coordinates coordinates, const Direction direction) {
-        position = {coordinates, direction};
+        if constexpr (RANGED) {
+            if (!Range::contains(coordinates.get_x(), coordinates.get_y()))
+                throw CoordinatesOutOfRange();
+        }
+        position = {convert_coordinates<coordinate_type>(coordinates),
+                    direction};
         landed = true;
-        stopped = false;
+        stop = StopReason::NONE;
+        _observer.on_land(current());
+    }
+};
+
+template <class... Sensors>
+using BasicRover = PolicyRover<DefaultRoverPolicy, Sensors...>;
+
+// The type-erased rover: any number of sensors chosen at run time.
+using Rover = BasicRover<sensors_t>;
+
+// Builder of a BasicRover; every sensor added changes its type.
+template <class... Sensors>
+class BasicRoverBuilder {
+private:
+    commands_t commands;
+    command_tokens_t command_tokens;
+    std::tuple<Sensors...> sensors;
+
+    template <class... Other>
+    friend class BasicRoverBuilder;
+
+public:
+    BasicRoverBuilder() = default;
+
+    BasicRoverBuilder(commands_t commands_, command_tokens_t command_tokens_,
+                      std::tuple<Sensors...> sensors_) :
+        commands(std::move(commands_)),
+        command_tokens(std::move(command_tokens_)),
+        sensors(std::move(sensors_)) {}
+
+    BasicRoverBuilder& program_command(command_name_t name,
+                                       std::shared_ptr<Action> action) {
+        commands[name] = std::move(action);
+        return *this;
+    }
+
+    // Longer tokens are matched greedily: the longest one programmed wins.
+    BasicRoverBuilder& program_command(std::string_view token,
+                                       std::shared_ptr<Action> action) {
+        if (token.size() == 1)
+            commands[token[0]] = std::move(action);
+        else if (!token.empty())
+            command_tokens[std::string(token)] = std::move(action);
+        return *this;
+    }
+
+    template <class S>
+    BasicRoverBuilder<Sensors..., S> add_sensor(S sensor) {
+        return {std::move(commands), std::move(command_tokens),
+                std::tuple_cat(std::move(sensors),
+                               std::make_tuple(std::move(sensor)))};
+    }
+
+    // Builds a rover of the given policy, for example one with an
+    // observer: build<Traced>().
+    template <class Policy = DefaultRoverPolicy>
+    PolicyRover<Policy, Sensors...> build() {
+        return std::make_from_tuple<PolicyRover<Policy, Sensors...>>(
+                std::tuple_cat(std::forward_as_tuple(commands, command_tokens),
+                               std::move(sensors)));
     }
 };
 
 class RoverBuilder {
 private:
     commands_t commands;
+    command_tokens_t command_tokens;
     sensors_t sensors;
+    bool cache_safe = false;
+    std::shared_ptr<const WorldVersion> world_version;
 public:
     RoverBuilder& program_command(command_name_t name,
                                   std::shared_ptr<Action> action) {
@@ -286,13 +2321,42 @@ public:
         return *this;
     }
 
+    // Longer tokens are matched greedily: the longest one programmed wins.
+    RoverBuilder& program_command(std::string_view token,
+                                  std::shared_ptr<Action> action) {
+        if (token.size() == 1)
+            commands[token[0]] = std::move(action);
+        else if (!token.empty())
+            command_tokens[std::string(token)] = std::move(action);
+        return *this;
+    }
+
     RoverBuilder& add_sensor(std::unique_ptr<Sensor> sensor) {
         sensors.push_back(std::move(sensor));
         return *this;
     }
 
-    Rover build() {
-        return {commands, std::move(sensors)};
+    // The built rover remembers the cells certified safe around it and
+    // skips its sensors while moving inside them. The cache is dropped
+    // whenever the given world version is bumped.
+    RoverBuilder& cache_safe_region(
+            std::shared_ptr<const WorldVersion> version = nullptr) {
+        cache_safe = true;
+        world_version = std::move(version);
+        return *this;
+    }
+
+    // Builds a rover of the given policy, for example one with an
+    // observer: build<Traced>(). Behind a safe region cache, observers see
+    // the cache as the rover's only sensor.
+    template <class Policy = DefaultRoverPolicy>
+    PolicyRover<Policy, sensors_t> build() {
+        if (cache_safe) {
+            sensors_t cached = {std::make_shared<SafeRegionCache>(
+                    std::move(sensors), world_version)};
+            return {commands, command_tokens, std::move(cached)};
+        }
+        return {commands, command_tokens, std::move(sensors)};
     }
 };
 
@@ -0,0 +1,416 @@
+#ifndef RTREE_SENSOR_H
+#define RTREE_SENSOR_H
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+#include "rover.h"
+
+// Axis-aligned dangerous rectangle, both corners inclusive.
+struct HazardRect {
+    coordinate_t x0, y0, x1, y1;
+};
+
+// Dangerous polygon. A cell is dangerous when its point lies inside
+// the polygon or on its boundary.
+struct HazardPolygon {
+    std::vector<std::pair<coordinate_t, coordinate_t>> vertices;
+};
+
+// Sensor reporting cells covered by rectangles or polygons as dangerous.
+// Shapes are kept in a packed R-tree bulk-loaded with Sort-Tile-Recursive:
+// every node's children are stored next to each other in one array, so
+// a query walks contiguous memory. Besides point queries it answers
+// segment queries, so a straight run of moves costs one traversal.
+class RTreeSensor : public Sensor {
+private:
+    constexpr static size_t NODE_CAPACITY = 16;
+    constexpr static int32_t RECTANGLE = -1;
+
+    struct Box {
+        coordinate_t x0, y0, x1, y1;
+
+        bool intersects(const Box &other) const {
+            return x0 <= other.x1 && other.x0 <= x1 &&
+                   y0 <= other.y1 && other.y0 <= y1;
+        }
+
+        void extend(const Box &other) {
+            x0 = std::min(x0, other.x0);
+            y0 = std::min(y0, other.y0);
+            x1 = std::max(x1, other.x1);
+            y1 = std::max(y1, other.y1);
+        }
+
+        int64_t center_x() const { return int64_t{x0} + x1; }
+        int64_t center_y() const { return int64_t{y0} + y1; }
+    };
+
+    // Children of a node are nodes[first, first + count), or entries
+    // with these indices for a leaf.
+    struct Node {
+        Box box;
+        uint32_t first;
+        uint32_t count;
+        bool leaf;
+    };
+
+    std::vector<Box> entry_boxes;
+    // RECTANGLE or the index of the polygon an entry stands for.
+    std::vector<int32_t> entry_shapes;
+    std::vector<HazardPolygon> polygons;
+    std::vector<Node> nodes;
+    // Crossings of the polygon edges with the line of a query.
+    std::vector<int64_t> crossings;
+
+    static Box bounding_box(const HazardPolygon &polygon) {
+        Box box{INT32_MAX, INT32_MAX, INT32_MIN, INT32_MIN};
+        for (const auto &[x, y] : polygon.vertices)
+            box.extend({x, y, x, y});
+        return box;
+    }
+
+    // Sign of a * b - c * d for |a|, |b|, |c|, |d| < 2^32, whose products
+    // overflow int64_t but not their magnitudes uint64_t.
+    static int cross_sign(int64_t a, int64_t b, int64_t c, int64_t d) {
+        auto sign = [](int64_t v) { return (v > 0) - (v < 0); };
+        auto magnitude = [](int64_t v) {
+            return static_cast<uint64_t>(v < 0 ? -v : v);
+        };
+        int left = sign(a) * sign(b), right = sign(c) * sign(d);
+        if (left != right)
+            return left > right ? 1 : -1;
+        uint64_t l = magnitude(a) * magnitude(b);
+        uint64_t r = magnitude(c) * magnitude(d);
+        if (l == r)
+            return 0;
+        return (l > r) == (left > 0) ? 1 : -1;
+    }
+
+    static bool inside(const HazardPolygon &polygon,
+                       coordinate_t px, coordinate_t py) {
+        const auto &v = polygon.vertices;
+        bool result = false;
+        for (size_t i = 0, j = v.size() - 1; i < v.size(); j = i++) {
+            int64_t xi = v[i].first, yi = v[i].second;
+            int64_t xj = v[j].first, yj = v[j].second;
+            int cross = cross_sign(xj - xi, py - yi, yj - yi, px - xi);
+            // Points on the boundary count as inside.
+            if (cross == 0 && std::min(xi, xj) <= px &&
+                    px <= std::max(xi, xj) && std::min(yi, yj) <= py &&
+                    py <= std::max(yi, yj))
+                return true;
+            if ((yi > py) != (yj > py)) {
+                // The edge crosses the horizontal ray going east from
+                // the point iff the point is on its left side.
+                bool upward = yj > yi;
+                if ((cross > 0) == upward)
+                    result = !result;
+            }
+        }
+        return result;
+    }
+
+    // Calls span(lo, hi) for ranges [lo, hi] of t together covering the
+    // points of the polygon, inside or on its boundary, on the line
+    // y = c, with t = x, or on the line x = c, with t = y, if vertical.
+    // Each edge is met once, so a long run costs O(V log V) rather than
+    // a point test per cell.
+    template <class Span>
+    void inside_spans(const HazardPolygon &polygon, bool vertical,
+                      int64_t c, Span span) {
+        const auto &v = polygon.vertices;
+        auto along = [&](size_t i) -> int64_t {
+            return vertical ? v[i].second : v[i].first;
+        };
+        auto across = [&](size_t i) -> int64_t {
+            return vertical ? v[i].first : v[i].second;
+        };
+        crossings.clear();
+        for (size_t i = 0, j = v.size() - 1; i < v.size(); j = i++) {
+            int64_t ai = across(i), aj = across(j);
+            int64_t ti = along(i), tj = along(j);
+            if (ai == aj) {
+                // An edge along the line is boundary from end to end.
+                if (ai == c)
+                    span(std::min(ti, tj), std::max(ti, tj));
+                continue;
+            }
+            if (c < std::min(ai, aj) || c > std::max(ai, aj))
+                continue;
+            // The edge meets the line at t = ti + n * m / den, whose
+            // magnitudes are below 2^32: floor it in unsigned 64 bits.
+            int64_t n = c - ai, m = tj - ti, den = aj - ai;
+            if (den < 0) {
+                den = -den;
+                n = -n;
+            }
+            auto magnitude = [](int64_t a) {
+                return static_cast<uint64_t>(a < 0 ? -a : a);
+            };
+            uint64_t product = magnitude(n) * magnitude(m);
+            auto q = static_cast<int64_t>(product / static_cast<uint64_t>(den));
+            bool exact = product % static_cast<uint64_t>(den) == 0;
+            bool negative = (n < 0) != (m < 0);
+            int64_t floor = negative ? ti - q - !exact : ti + q;
+            if (exact)
+                span(floor, floor);
+            // As in inside(): the edge crosses the ray going towards
+            // larger t from every t below the meeting point, and the
+            // points crossing it an odd number of times are inside.
+            if ((ai > c) != (aj > c))
+                crossings.push_back(exact ? floor - 1 : floor);
+        }
+        std::sort(crossings.begin(), crossings.end());
+        for (size_t i = 0; i + 1 < crossings.size(); i += 2) {
+            if (crossings[i] < crossings[i + 1])
+                span(crossings[i] + 1, crossings[i + 1]);
+        }
+    }
+
+    bool entry_contains(uint32_t entry, coordinate_t x, coordinate_t y) const {
+        int32_t shape = entry_shapes[entry];
+        return shape == RECTANGLE || inside(polygons[shape], x, y);
+    }
+
+    // Sort-Tile-Recursive packing of items [0, n) into groups of at most
+    // NODE_CAPACITY, reordering order so that each group is contiguous.
+    template <class Center>
+    static void str_order(std::vector<uint32_t> &order, Center center) {
+        size_t n = order.size();
+        size_t groups = (n + NODE_CAPACITY - 1) / NODE_CAPACITY;
+        auto slices = static_cast<size_t>(std::ceil(std::sqrt(groups)));
+        size_t slice_size = slices * NODE_CAPACITY;
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            return center(a).first < center(b).first;
+        });
+        for (size_t begin = 0; begin < n; begin += slice_size) {
+            auto end = order.begin() + std::min(n, begin + slice_size);
+            std::sort(order.begin() + begin, end, [&](uint32_t a, uint32_t b) {
+                return center(a).second < center(b).second;
+            });
+        }
+    }
+
+    void build() {
+        size_t n = entry_boxes.size();
+        if (n == 0)
+            return;
+
+        std::vector<uint32_t> order(n);
+        for (uint32_t i = 0; i < n; ++i)
+            order[i] = i;
+        str_order(order, [&](uint32_t i) {
+            return std::make_pair(entry_boxes[i].center_x(),
+                                  entry_boxes[i].center_y());
+        });
+        std::vector<Box> boxes(n);
+        std::vector<int32_t> shapes(n);
+        for (size_t i = 0; i < n; ++i) {
+            boxes[i] = entry_boxes[order[i]];
+            shapes[i] = entry_shapes[order[i]];
+        }
+        entry_boxes = std::move(boxes);
+        entry_shapes = std::move(shapes);
+
+        // Leaves, then each upper level built over the one below it.
+        std::vector<Node> level;
+        for (size_t begin = 0; begin < n; begin += NODE_CAPACITY) {
+            size_t end = std::min(n, begin + NODE_CAPACITY);
+            Node node{entry_boxes[begin], static_cast<uint32_t>(begin),
+                      static_cast<uint32_t>(end - begin), true};
+            for (size_t i = begin + 1; i < end; ++i)
+                node.box.extend(entry_boxes[i]);
+            level.push_back(node);
+        }
+
+        std::vector<std::vector<Node>> levels;
+        while (level.size() > 1) {
+            order.resize(level.size());
+            for (uint32_t i = 0; i < level.size(); ++i)
+                order[i] = i;
+            str_order(order, [&](uint32_t i) {
+                return std::make_pair(level[i].box.center_x(),
+                                      level[i].box.center_y());
+            });
+            std::vector<Node> sorted;
+            for (uint32_t i : order)
+                sorted.push_back(level[i]);
+
+            std::vector<Node> parents;
+            for (size_t begin = 0; begin < sorted.size();
+                    begin += NODE_CAPACITY) {
+                size_t end = std::min(sorted.size(), begin + NODE_CAPACITY);
+                Node node{sorted[begin].box, static_cast<uint32_t>(begin),
+                          static_cast<uint32_t>(end - begin), false};
+                for (size_t i = begin + 1; i < end; ++i)
+                    node.box.extend(sorted[i].box);
+                parents.push_back(node);
+            }
+            levels.push_back(std::move(sorted));
+            level = std::move(parents);
+        }
+        levels.push_back(std::move(level));
+
+        // Lay levels out root first; child indices become absolute.
+        nodes.clear();
+        for (auto it = levels.rbegin(); it != levels.rend(); ++it) {
+            size_t next_level = nodes.size() + it->size();
+            for (Node node : *it) {
+                if (!node.leaf)
+                    node.first += static_cast<uint32_t>(next_level);
+                nodes.push_back(node);
+            }
+        }
+    }
+
+    // Calls on_entry for every entry whose box intersects query. The
+    // callback may shrink query to prune the rest of the traversal.
+    template <class OnEntry>
+    void search(Box &query, OnEntry on_entry) const {
+        if (nodes.empty())
+            return;
+        // Depth is at most 8 levels of at most 16 children each.
+        uint32_t stack[256];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const Node &node = nodes[stack[--top]];
+            if (!node.box.intersects(query))
+                continue;
+            for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+                if (node.leaf) {
+                    if (entry_boxes[i].intersects(query))
+                        on_entry(i);
+                }
+                else if (nodes[i].box.intersects(query)) {
+                    stack[top++] = i;
+                }
+            }
+        }
+    }
+
+    // Clears in mask the bits of the dangerous cells (first..last, y),
+    // bit shift + i standing for (first + i, y).
+    void clear_row(coordinate_t first, coordinate_t last, coordinate_t y,
+                   int shift, uint64_t &mask) {
+        Box query{first, y, last, y};
+        auto clear = [&](int64_t from, int64_t to) {
+            for (int64_t cx = std::max<int64_t>(from, first);
+                    cx <= std::min<int64_t>(to, last); ++cx)
+                mask &= ~(uint64_t{1} << (cx - first + shift));
+        };
+        search(query, [&](uint32_t entry) {
+            const Box &box = entry_boxes[entry];
+            int32_t shape = entry_shapes[entry];
+            if (shape == RECTANGLE)
+                clear(box.x0, box.x1);
+            else
+                inside_spans(polygons[shape], false, y, clear);
+        });
+    }
+
+public:
+    RTreeSensor(std::vector<HazardRect> rectangles,
+                std::vector<HazardPolygon> polygons_ = {}) :
+        polygons(std::move(polygons_)) {
+        for (const auto &r : rectangles) {
+            entry_boxes.push_back({std::min(r.x0, r.x1), std::min(r.y0, r.y1),
+                                   std::max(r.x0, r.x1), std::max(r.y0, r.y1)});
+            entry_shapes.push_back(RECTANGLE);
+        }
+        for (size_t i = 0; i < polygons.size(); ++i) {
+            if (polygons[i].vertices.empty())
+                continue;
+            entry_boxes.push_back(bounding_box(polygons[i]));
+            entry_shapes.push_back(static_cast<int32_t>(i));
+        }
+        build();
+    }
+
+    bool is_safe(coordinate_t x, coordinate_t y) override {
+        Box query{x, y, x, y};
+        bool safe = true;
+        search(query, [&](uint32_t entry) {
+            if (safe && entry_contains(entry, x, y)) {
+                safe = false;
+                // Nothing else needs to be visited.
+                query = {1, 1, 0, 0};
+            }
+        });
+        return safe;
+    }
+
+    uint64_t safe_row(coordinate_t x, coordinate_t y, int width) override {
+        uint64_t mask = width == 64 ? ~uint64_t{0}
+                                    : (uint64_t{1} << width) - 1;
+        // Cells up to INT32_MAX, then those wrapping around to INT32_MIN.
+        int before_edge = static_cast<int>(
+                std::min<int64_t>(width, int64_t{INT32_MAX} - x + 1));
+        clear_row(x, static_cast<coordinate_t>(x + (before_edge - 1)), y, 0,
+                  mask);
+        if (before_edge < width)
+            clear_row(INT32_MIN, INT32_MIN + (width - before_edge - 1), y,
+                      before_edge, mask);
+        return mask;
+    }
+
+    coordinate_t safe_run(coordinate_t x, coordinate_t y, Direction d,
+                          coordinate_t limit) override {
+        int64_t dx = DirectionManager::get_dx(d);
+        int64_t dy = DirectionManager::get_dy(d);
+        limit = std::min({limit, DirectionManager::room(x, dx),
+                          DirectionManager::room(y, dy)});
+        if (limit <= 0)
+            return 0;
+
+        // Cells k = 1..limit steps away; best is the first dangerous one.
+        int64_t best = int64_t{limit} + 1;
+        auto cell_box = [&](int64_t k_first, int64_t k_last) {
+            int64_t ax = x + dx * k_first, bx = x + dx * k_last;
+            int64_t ay = y + dy * k_first, by = y + dy * k_last;
+            return Box{static_cast<coordinate_t>(std::min(ax, bx)),
+                       static_cast<coordinate_t>(std::min(ay, by)),
+                       static_cast<coordinate_t>(std::max(ax, bx)),
+                       static_cast<coordinate_t>(std::max(ay, by))};
+        };
+        // Step index of a coordinate along the heading.
+        auto step = [&](int64_t c) {
+            return dx != 0 ? (c - x) * dx : (c - y) * dy;
+        };
+
+        // Steps 1..best - 1 a range of t along the heading covers.
+        auto reach = [&](int64_t from, int64_t to) {
+            int64_t a = step(from), b = step(to);
+            int64_t first = std::max<int64_t>(std::min(a, b), 1);
+            if (first <= std::min(std::max(a, b), best - 1))
+                best = first;
+        };
+
+        Box query = cell_box(1, limit);
+        search(query, [&](uint32_t entry) {
+            const Box &box = entry_boxes[entry];
+            int32_t shape = entry_shapes[entry];
+            int64_t before = best;
+            if (shape == RECTANGLE)
+                reach(dx != 0 ? box.x0 : box.y0, dx != 0 ? box.x1 : box.y1);
+            else
+                inside_spans(polygons[shape], dx == 0, dx != 0 ? y : x, reach);
+            if (best < before)
+                query = best > 1 ? cell_box(1, best - 1) : Box{1, 1, 0, 0};
+        });
+        return static_cast<coordinate_t>(best - 1);
+    }
+
+    size_t memory_bytes() const {
+        size_t bytes = entry_boxes.size() * sizeof(Box) +
+                       entry_shapes.size() * sizeof(int32_t) +
+                       nodes.size() * sizeof(Node);
+        for (const auto &polygon : polygons)
+            bytes += polygon.vertices.size() * sizeof(polygon.vertices[0]);
+        return bytes;
+    }
+};
+
+#endif //RTREE_SENSOR_H
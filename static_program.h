@@ -0,0 +1,195 @@
+#ifndef STATIC_PROGRAM_H
+#define STATIC_PROGRAM_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <utility>
+#include "rover.h"
+
+// Entry of a compile-time command table: a command name and the primitive
+// steps it stands for, written with 'F' (move forward), 'B' (move
+// backward), 'L' (rotate left) and 'R' (rotate right).
+struct StaticCommand {
+    command_name_t name;
+    const char *steps;
+};
+
+// String literal usable as a template argument.
+template <size_t N>
+struct StaticString {
+    char data[N];
+
+    consteval StaticString(const char (&s)[N]) {
+        std::copy_n(s, N, data);
+    }
+
+    constexpr size_t size() const { return N - 1; }
+};
+
+// Everything a command list does, computed for a rover that starts at
+// (0, 0) heading north. The rover may stop before each probe: it then
+// stays at (at_x, at_y) heading after `turns` right turns.
+struct StaticProbe {
+    coordinate_t cell_x, cell_y;
+    coordinate_t at_x, at_y;
+    int turns;
+};
+
+template <size_t N>
+struct StaticTrace {
+    std::array<StaticProbe, N> probes{};
+    coordinate_t x = 0, y = 0;
+    int turns = 0;
+    bool unknown_command = false;
+};
+
+// Traces a command list through a command table at compile time.
+class StaticCompiler {
+private:
+    constexpr static coordinate_t forward_x[] = {0, 1, 0, -1};
+    constexpr static coordinate_t forward_y[] = {1, 0, -1, 0};
+
+    template <const auto &Table>
+    static consteval const char *find(command_name_t name) {
+        for (const StaticCommand &command : Table) {
+            if (command.name == name)
+                return command.steps;
+        }
+        return nullptr;
+    }
+
+    // Walks the steps, calling on_probe before each move.
+    template <StaticString Commands, const auto &Table, class OnProbe>
+    static consteval void walk(coordinate_t &x, coordinate_t &y, int &turns,
+                               bool &unknown_command, OnProbe on_probe) {
+        for (size_t i = 0; i < Commands.size(); ++i) {
+            const char *steps = find<Table>(Commands.data[i]);
+            if (steps == nullptr) {
+                unknown_command = true;
+                return;
+            }
+            for (; *steps != '\0'; ++steps) {
+                switch (*steps) {
+                    case 'F':
+                    case 'B': {
+                        int heading = *steps == 'F' ? turns : (turns + 2) % 4;
+                        coordinate_t cell_x = x + forward_x[heading];
+                        coordinate_t cell_y = y + forward_y[heading];
+                        on_probe(StaticProbe{cell_x, cell_y, x, y, turns});
+                        x = cell_x;
+                        y = cell_y;
+                        break;
+                    }
+                    case 'L':
+                        turns = (turns + 3) % 4;
+                        break;
+                    case 'R':
+                        turns = (turns + 1) % 4;
+                        break;
+                    default:
+                        throw "steps may only contain F, B, L and R";
+                }
+            }
+        }
+    }
+
+public:
+    template <StaticString Commands, const auto &Table>
+    static consteval size_t probe_count() {
+        coordinate_t x = 0, y = 0;
+        int turns = 0;
+        bool unknown_command = false;
+        size_t count = 0;
+        walk<Commands, Table>(x, y, turns, unknown_command,
+                              [&](StaticProbe) { ++count; });
+        return count;
+    }
+
+    template <StaticString Commands, const auto &Table>
+    static consteval auto trace() {
+        StaticTrace<probe_count<Commands, Table>()> result;
+        size_t count = 0;
+        walk<Commands, Table>(result.x, result.y, result.turns,
+                              result.unknown_command,
+                              [&](StaticProbe probe) {
+            result.probes[count++] = probe;
+        });
+        return result;
+    }
+};
+
+// Command list fixed at compile time. Its displacement and heading change
+// are constants, and running it only probes the sensors, once per move,
+// in a fully unrolled sequence:
+//
+//     constexpr StaticCommand table[] = {{'F', "F"}, {'U', "RR"}};
+//     using Patrol = StaticProgram<"FFUFF", table>;
+//     static_assert(Patrol::dx == 0 && Patrol::dy == 0);
+//     rover.execute(Patrol{});
+//
+// dx, dy and turns are given for a rover heading north and are rotated
+// at run time to the rover's heading.
+template <StaticString Commands, const auto &Table>
+class StaticProgram {
+private:
+    constexpr static auto program = StaticCompiler::trace<Commands, Table>();
+
+    struct Frame {
+        coordinate_t x, y;
+        int heading;
+
+        // Maps a point of the north-facing frame onto the map.
+        Coordinates place(coordinate_t lx, coordinate_t ly) const {
+            for (int i = 0; i < heading; ++i) {
+                coordinate_t t = lx;
+                lx = ly;
+                ly = -t;
+            }
+            return {static_cast<coordinate_t>(static_cast<uint32_t>(x) +
+                                              static_cast<uint32_t>(lx)),
+                    static_cast<coordinate_t>(static_cast<uint32_t>(y) +
+                                              static_cast<uint32_t>(ly))};
+        }
+
+        Position position(coordinate_t lx, coordinate_t ly, int turns) const {
+            return {place(lx, ly),
+                    static_cast<Direction>((heading + turns) % 4)};
+        }
+    };
+
+    template <size_t I, class Probe>
+    static bool probe(const Frame &frame, Position &p, Probe &sensors) {
+        constexpr StaticProbe step = program.probes[I];
+        Coordinates cell = frame.place(step.cell_x, step.cell_y);
+        if (sensors.is_safe(cell.get_x(), cell.get_y()))
+            return true;
+        p = frame.position(step.at_x, step.at_y, step.turns);
+        return false;
+    }
+
+public:
+    constexpr static coordinate_t dx = program.x;
+    constexpr static coordinate_t dy = program.y;
+    constexpr static int turns = program.turns;
+    constexpr static size_t probes = program.probes.size();
+    // The list contains a command missing from the table, so the rover
+    // stops there.
+    constexpr static bool stops = program.unknown_command;
+
+    // Asks the probe about every field entered.
+    template <class Probe>
+    static bool run(Position &p, Probe &sensors) {
+        Frame frame{p.get_coordinates().get_x(), p.get_coordinates().get_y(),
+                    static_cast<int>(p.get_direction())};
+        bool safe = [&]<size_t... I>(std::index_sequence<I...>) {
+            return (probe<I>(frame, p, sensors) && ...);
+        }(std::make_index_sequence<probes>());
+        if (!safe)
+            return false;
+        p = frame.position(dx, dy, turns);
+        return !stops;
+    }
+};
+
+#endif //STATIC_PROGRAM_H
@@ -0,0 +1,309 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <atomic>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include "rover.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Thrown when a telemetry region cannot be made or opened, or what is
+// opened is not one.
+class TelemetryUnavailable : public std::exception {
+public:
+    const char *what() const noexcept override {
+        return "Telemetry unavailable";
+    }
+};
+
+// Live state of one rover, as published to a TelemetryRegion.
+struct TelemetryRecord {
+    coordinate_t x = 0, y = 0;
+    Direction direction = Direction::NORTH;
+    bool landed = false;
+    bool stopped = false;
+    StopReason reason = StopReason::NONE;
+    uint64_t executes = 0;
+    uint64_t commands = 0;
+    uint64_t stops = 0;
+};
+
+// Slots of rover state in POSIX shared memory, one writer each, read by
+// any number of processes without system calls or locks. Every slot is
+// a seqlock: its sequence is odd while the writer changes it, and a
+// reader copying it retries until it sees the same even sequence before
+// and after, giving up after READ_ATTEMPTS tries. The creator sizes the
+// region and removes its name when destroyed; readers open it by name,
+// read-only:
+//
+//     TelemetryRegion region("/rovers", 4096);       // the controller
+//     TelemetryRegion monitor("/rovers");            // another process
+//     std::optional<TelemetryRecord> r = monitor.read(17);
+class TelemetryRegion {
+private:
+    constexpr static uint64_t MAGIC = 0x524f564552544c4d; // "ROVERTLM"
+    constexpr static uint32_t VERSION = 1;
+
+    struct Header {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t slot_size;
+        uint64_t slots;
+    };
+
+    struct alignas(64) Slot {
+        std::atomic<uint32_t> sequence;
+        // Direction, landed, stopped and StopReason, a byte each.
+        std::atomic<uint32_t> state;
+        std::atomic<coordinate_t> x, y;
+        std::atomic<uint64_t> executes, commands, stops;
+    };
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free &&
+                  std::atomic<uint32_t>::is_always_lock_free &&
+                  std::atomic<coordinate_t>::is_always_lock_free,
+                  "Slots shared between processes must be lock free");
+
+    constexpr static size_t SLOTS_OFFSET = 64;
+
+    std::string name;
+    bool owner = false;
+    void *memory = nullptr;
+    size_t length = 0;
+    Slot *slots = nullptr;
+    size_t count = 0;
+
+    static size_t bytes(size_t slots) {
+        return SLOTS_OFFSET + slots * sizeof(Slot);
+    }
+
+    void map(int fd, int protection) {
+        memory = mmap(nullptr, length, protection, MAP_SHARED, fd, 0);
+        close(fd);
+        if (memory == MAP_FAILED) {
+            memory = nullptr;
+            throw TelemetryUnavailable();
+        }
+        slots = reinterpret_cast<Slot *>(
+                static_cast<char *>(memory) + SLOTS_OFFSET);
+    }
+
+    void check(size_t slot) const {
+        if (slot >= count)
+            throw std::out_of_range("Telemetry slot out of range");
+    }
+
+    void release() {
+        if (memory != nullptr)
+            munmap(memory, length);
+        if (owner)
+            shm_unlink(name.c_str());
+        memory = nullptr;
+    }
+
+public:
+    // Makes a region of zeroed slots. Throws TelemetryUnavailable when
+    // the name is taken, so that a live publisher is never replaced; the
+    // region of one that died is removed with remove().
+    TelemetryRegion(std::string name_, size_t slots_) :
+        name(std::move(name_)), owner(true), length(bytes(slots_)),
+        count(slots_) {
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+        if (fd < 0)
+            throw TelemetryUnavailable();
+        if (ftruncate(fd, static_cast<off_t>(length)) != 0) {
+            close(fd);
+            shm_unlink(name.c_str());
+            throw TelemetryUnavailable();
+        }
+        try {
+            map(fd, PROT_READ | PROT_WRITE);
+        }
+        catch (TelemetryUnavailable &) {
+            shm_unlink(name.c_str());
+            throw;
+        }
+        Header header{MAGIC, VERSION, sizeof(Slot), count};
+        std::memcpy(memory, &header, sizeof(header));
+    }
+
+    // Opens the region another process made, for reading.
+    explicit TelemetryRegion(std::string name_) : name(std::move(name_)) {
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0)
+            throw TelemetryUnavailable();
+        struct stat st;
+        if (fstat(fd, &st) != 0 ||
+                static_cast<size_t>(st.st_size) < SLOTS_OFFSET) {
+            close(fd);
+            throw TelemetryUnavailable();
+        }
+        length = static_cast<size_t>(st.st_size);
+        map(fd, PROT_READ);
+        Header header;
+        std::memcpy(&header, memory, sizeof(header));
+        if (header.magic != MAGIC || header.version != VERSION ||
+                header.slot_size != sizeof(Slot) ||
+                bytes(header.slots) > length) {
+            release();
+            throw TelemetryUnavailable();
+        }
+        count = header.slots;
+    }
+
+    TelemetryRegion(TelemetryRegion &&other) noexcept :
+        name(std::move(other.name)), owner(std::exchange(other.owner, false)),
+        memory(std::exchange(other.memory, nullptr)), length(other.length),
+        slots(other.slots), count(other.count) {}
+
+    TelemetryRegion &operator=(TelemetryRegion &&other) noexcept {
+        if (this != &other) {
+            release();
+            name = std::move(other.name);
+            owner = std::exchange(other.owner, false);
+            memory = std::exchange(other.memory, nullptr);
+            length = other.length;
+            slots = other.slots;
+            count = other.count;
+        }
+        return *this;
+    }
+
+    TelemetryRegion(const TelemetryRegion &) = delete;
+    TelemetryRegion &operator=(const TelemetryRegion &) = delete;
+
+    ~TelemetryRegion() {
+        release();
+    }
+
+    // Removes the name of a region whose creator died without removing
+    // it. Readers that opened it keep reading what it last published.
+    static void remove(const std::string &name) {
+        shm_unlink(name.c_str());
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    // Writes a slot; only one thread may write each slot. Throws
+    // std::out_of_range for slots past size().
+    void publish(size_t slot, const TelemetryRecord &r) {
+        check(slot);
+        Slot &s = slots[slot];
+        uint32_t sequence = s.sequence.load(std::memory_order_relaxed);
+        s.sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        s.state.store(static_cast<uint32_t>(r.direction) |
+                      uint32_t{r.landed} << 8 | uint32_t{r.stopped} << 16 |
+                      static_cast<uint32_t>(r.reason) << 24,
+                      std::memory_order_relaxed);
+        s.x.store(r.x, std::memory_order_relaxed);
+        s.y.store(r.y, std::memory_order_relaxed);
+        s.executes.store(r.executes, std::memory_order_relaxed);
+        s.commands.store(r.commands, std::memory_order_relaxed);
+        s.stops.store(r.stops, std::memory_order_relaxed);
+        s.sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    // Tries a reader makes before taking a slot for one whose writer died
+    // halfway through a write.
+    constexpr static int READ_ATTEMPTS = 1 << 16;
+
+    // A consistent copy of a slot, retrying while it is being written;
+    // empty when it stays half written for READ_ATTEMPTS tries. Throws
+    // std::out_of_range for slots past size().
+    std::optional<TelemetryRecord> read(size_t slot) const {
+        check(slot);
+        const Slot &s = slots[slot];
+        TelemetryRecord r;
+        for (int attempt = 0; attempt < READ_ATTEMPTS; ++attempt) {
+            uint32_t before = s.sequence.load(std::memory_order_acquire);
+            if (before & 1)
+                continue;
+            uint32_t state = s.state.load(std::memory_order_relaxed);
+            r.x = s.x.load(std::memory_order_relaxed);
+            r.y = s.y.load(std::memory_order_relaxed);
+            r.executes = s.executes.load(std::memory_order_relaxed);
+            r.commands = s.commands.load(std::memory_order_relaxed);
+            r.stops = s.stops.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (s.sequence.load(std::memory_order_relaxed) != before)
+                continue;
+            r.direction = static_cast<Direction>(state & 0xff);
+            r.landed = state >> 8 & 1;
+            r.stopped = state >> 16 & 1;
+            r.reason = static_cast<StopReason>(state >> 24);
+            return r;
+        }
+        return std::nullopt;
+    }
+};
+
+// Observer publishing a rover's state to a slot of a TelemetryRegion
+// after every landing and every execute. Rovers publish nothing until
+// attached to a slot, which no other rover may use:
+//
+//     struct Monitored : DefaultRoverPolicy {
+//         using observer_type = TelemetryObserver;
+//     };
+//     rover.observer().attach(region, 17);
+class TelemetryObserver : public NullObserver {
+private:
+    TelemetryRegion *region = nullptr;
+    size_t slot = 0;
+    TelemetryRecord record;
+
+    void publish(const Position &p) {
+        record.x = p.get_coordinates().get_x();
+        record.y = p.get_coordinates().get_y();
+        record.direction = p.get_direction();
+        if (region != nullptr)
+            region->publish(slot, record);
+    }
+
+public:
+    // Throws std::out_of_range for slots past the region's size(), before
+    // the rover publishes anything.
+    void attach(TelemetryRegion &r, size_t s) {
+        if (s >= r.size())
+            throw std::out_of_range("Telemetry slot out of range");
+        region = &r;
+        slot = s;
+    }
+
+    void on_land(const Position &p) {
+        record.landed = true;
+        record.stopped = false;
+        record.reason = StopReason::NONE;
+        publish(p);
+    }
+
+    void on_execute_begin([[maybe_unused]] const Position &p) {
+        ++record.executes;
+    }
+
+    void on_dispatch([[maybe_unused]] std::string_view command) {
+        ++record.commands;
+    }
+
+    void on_stop([[maybe_unused]] const Position &p,
+                 [[maybe_unused]] StopReason reason) {
+        ++record.stops;
+    }
+
+    void on_execute_end(const Position &p, StopReason reason) {
+        record.stopped = reason != StopReason::NONE;
+        record.reason = reason;
+        publish(p);
+    }
+};
+
+#endif //TELEMETRY_H
@@ -0,0 +1,162 @@
+#include <cassert>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include "../generator.h"
+
+bool near(double observed, double expected, double tolerance) {
+    return std::abs(observed - expected) <= tolerance;
+}
+
+// Share of the fields of [x0, x0 + size) x [y0, y0 + size) that are
+// dangerous.
+double density(GeneratedHazards &map, coordinate_t x0, coordinate_t y0,
+               coordinate_t size) {
+    uint64_t dangerous = 0;
+    for (coordinate_t x = x0; x < x0 + size; ++x)
+        for (coordinate_t y = y0; y < y0 + size; ++y)
+            dangerous += !map.is_safe(x, y);
+    return static_cast<double>(dangerous) / (double{1} * size * size);
+}
+
+void hazards() {
+    // The share of dangerous fields is the density asked for, scattered
+    // or in clusters.
+    GeneratedHazards scattered({.seed = 3, .density = 0.1});
+    assert(near(density(scattered, -150, -150, 300), 0.1, 0.01));
+    GeneratedHazards blobs({.seed = 3, .density = 0.1, .clustering = 1,
+                            .cluster_log2 = 3});
+    assert(near(density(blobs, -256, -256, 512), 0.1, 0.02));
+    GeneratedHazards none({.seed = 3, .density = 0});
+    assert(density(none, -20, -20, 40) == 0);
+
+    // Fully clustered fields follow their square, on either side of 0.
+    for (coordinate_t x = -64; x < 64; ++x)
+        for (coordinate_t y = -64; y < 64; ++y)
+            assert(blobs.is_safe(x, y) == blobs.is_safe(x & ~7, y & ~7));
+
+    // Corridors stay safe in a world of nothing but hazards.
+    GeneratedHazards walls({.seed = 5, .density = 1,
+                            .corridor_spacing = 7});
+    for (coordinate_t x = -50; x <= 50; ++x)
+        for (coordinate_t y = -50; y <= 50; ++y)
+            assert(walls.is_safe(x, y) == (x % 7 == 0 || y % 7 == 0));
+    assert(walls.is_safe(INT32_MIN + 1, 1) ==
+           (int64_t{INT32_MIN + 1} % 7 == 0));
+
+    // The same seed gives the same map, another seed another one.
+    HazardOptions options{.seed = 11, .density = 0.3, .clustering = 0.5};
+    GeneratedHazards a(options), b(options);
+    options.seed = 12;
+    GeneratedHazards c(options);
+    bool differs = false;
+    for (coordinate_t x = -40; x < 40; ++x) {
+        for (coordinate_t y = -40; y < 40; ++y) {
+            assert(a.is_safe(x, y) == b.is_safe(x, y));
+            differs |= a.is_safe(x, y) != c.is_safe(x, y);
+        }
+    }
+    assert(differs);
+}
+
+// Levels of compose nested in an action.
+int nesting(const std::shared_ptr<Action> &action) {
+    auto composed = std::dynamic_pointer_cast<Compose>(action);
+    if (!composed)
+        return 0;
+    int deepest = 0;
+    for (const auto &each : composed->actions())
+        deepest = std::max(deepest, nesting(each));
+    return deepest + 1;
+}
+
+void statistics() {
+    constexpr size_t LENGTH = 200000;
+    auto shares = [](const std::string &list) {
+        std::map<char, double> result;
+        for (char c : list)
+            result[c] += 1.0 / static_cast<double>(list.size());
+        return result;
+    };
+
+    // Turns against moves, and forward against backward moves.
+    auto primitives = shares(CommandGenerator({.seed = 1, .turn_share = 0.25})
+                                     .next(LENGTH));
+    assert(near(primitives['L'] + primitives['R'], 0.25, 0.01));
+    assert(near(primitives['F'], 0.75 * 0.75, 0.01));
+    assert(primitives.size() == 4);
+
+    // Unknown commands and composed ones of every level.
+    auto mixed = shares(CommandGenerator({.seed = 2, .compose_share = 0.2,
+                                          .compose_depth = 3,
+                                          .unknown_share = 0.05})
+                                .next(LENGTH));
+    assert(near(mixed['X'], 0.05, 0.005));
+    for (char level : {'1', '2', '3'})
+        assert(near(mixed[level], 0.95 * 0.2 / 3, 0.005));
+    assert(!mixed.contains('4'));
+
+    // Commands come in runs of 1 to max_run, 3 on average, and a run
+    // goes on into the next one of the same command: with turns only,
+    // one in two.
+    std::string turns = CommandGenerator({.seed = 4, .turn_share = 1,
+                                          .max_run = 5}).next(LENGTH);
+    size_t runs = 1;
+    for (size_t i = 1; i < turns.size(); ++i)
+        runs += turns[i] != turns[i - 1];
+    assert(near(static_cast<double>(LENGTH) / static_cast<double>(runs),
+                6, 0.3));
+    std::string single = CommandGenerator({.seed = 4, .turn_share = 1})
+            .next(LENGTH);
+    runs = 1;
+    for (size_t i = 1; i < single.size(); ++i)
+        runs += single[i] != single[i - 1];
+    assert(near(static_cast<double>(LENGTH) / static_cast<double>(runs),
+                2, 0.1));
+
+    // Level k commands nest k composes; levels stop at 9.
+    commands_t commands = CommandGenerator({.seed = 6, .compose_depth = 3})
+            .commands();
+    for (int level = 1; level <= 3; ++level)
+        assert(nesting(commands.at(static_cast<char>('0' + level))) == level);
+    assert(!commands.contains('4'));
+    commands = CommandGenerator({.compose_depth = 12}).commands();
+    assert(nesting(commands.at('9')) == 9 && commands.size() == 4 + 9);
+}
+
+// The whole list written with the given chunk size.
+std::string written(const CommandOptions &options, uint64_t length,
+                    size_t chunk_size) {
+    CommandGenerator generator(options);
+    std::stringstream s;
+    generator.write(s, length, chunk_size);
+    return s.str();
+}
+
+int main() {
+    CommandOptions options{.seed = 7, .compose_share = 0.2,
+                           .compose_depth = 3, .max_run = 5,
+                           .unknown_share = 0.01};
+
+    // The same seed gives the same list at any chunk size.
+    std::string whole = CommandGenerator(options).next(5000);
+    assert(whole.size() == 5000);
+    for (size_t chunk_size : {size_t{1}, size_t{3}, size_t{64}, size_t{4999},
+                              size_t{5000}, size_t{1} << 16})
+        assert(written(options, 5000, chunk_size) == whole);
+
+    // A chunk size of 0 is taken as 1 rather than never ending.
+    assert(written(options, 5000, 0) == whole);
+    assert(written(options, 0, 0).empty());
+
+    // Lists go on where the last one ended.
+    CommandGenerator generator(options);
+    std::string first = generator.next(1234);
+    assert(first + generator.next(5000 - 1234) == whole);
+
+    hazards();
+    statistics();
+    return 0;
+}
@@ -0,0 +1,134 @@
+#include <cassert>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "../latency.h"
+
+struct TrueSensor : public Sensor {
+    bool is_safe([[maybe_unused]] coordinate_t x,
+                 [[maybe_unused]] coordinate_t y) override {
+        return true;
+    }
+};
+
+// Fields from y = 3 on are dangerous.
+struct Wall : public Sensor {
+    bool is_safe([[maybe_unused]] coordinate_t x, coordinate_t y) override {
+        return y < 3;
+    }
+};
+
+struct Timed : DefaultRoverPolicy {
+    using observer_type = LatencyObserver;
+};
+
+using TimedRover = PolicyRover<Timed, sensors_t>;
+
+const commands_t commands = {{'F', move_forward()}, {'R', rotate_right()}};
+const command_tokens_t command_tokens = {{"F5", repeat(5, move_forward())}};
+
+TimedRover make_rover() {
+    return {commands, command_tokens,
+            sensors_t{std::make_shared<TrueSensor>(),
+                      std::make_shared<Wall>()}};
+}
+
+const HistogramSnapshot &command(const LatencySnapshot &s,
+                                 std::string_view name) {
+    for (const auto &[token, histogram] : s.commands) {
+        if (token == name)
+            return histogram;
+    }
+    assert(false);
+    return s.execute;
+}
+
+void check_buckets() {
+    using B = LatencyBuckets;
+    assert(B::bucket(0) == 0 && B::lowest(0) == 0);
+    // The buckets cover all values without gaps or overlaps.
+    for (size_t b = 0; b + 1 < B::COUNT; ++b) {
+        assert(B::highest(b) + 1 == B::lowest(b + 1));
+        assert(B::bucket(B::lowest(b)) == b && B::bucket(B::highest(b)) == b);
+    }
+    assert(B::highest(B::COUNT - 1) == UINT64_MAX);
+    // Small values are exact, larger ones within 1/32 of their bucket.
+    for (size_t b = 0; b + 1 < B::COUNT; ++b) {
+        uint64_t width = B::highest(b) - B::lowest(b) + 1;
+        if (b < 2 * B::HALF)
+            assert(width == 1);
+        else
+            assert(width * B::HALF <= B::lowest(b));
+    }
+    uint64_t top = uint64_t{1} << B::MAX_BITS;
+    assert(B::bucket(top - 1) == B::COUNT - 1);
+    assert(B::bucket(top) == B::COUNT - 1);
+    assert(B::bucket(UINT64_MAX) == B::COUNT - 1);
+    for (uint64_t v : {uint64_t{63}, uint64_t{64}, uint64_t{65}, uint64_t{1000},
+                       uint64_t{123456789}, top / 3}) {
+        size_t b = B::bucket(v);
+        assert(B::lowest(b) <= v && v <= B::highest(b));
+    }
+}
+
+int main() {
+    check_buckets();
+
+    // Three steps north into the wall, then five east by a segment query,
+    // then an unknown command.
+    LatencyRecorder recorder(commands, 2, command_tokens);
+    TimedRover rover = make_rover();
+    rover.land({0, 0}, Direction::NORTH);
+    rover.execute("F");
+    assert(recorder.snapshot().execute.count() == 0);
+    rover.observer().attach(recorder);
+    rover.execute("FF");
+    rover.execute("RF5X");
+    rover.execute("X");
+    LatencySnapshot s = recorder.snapshot();
+    assert(s.execute.count() == 3);
+    assert(command(s, "F").count() == 2);
+    assert(command(s, "R").count() == 1);
+    assert(command(s, "F5").count() == 1);
+    assert(s.sensors.size() == 2);
+    assert(s.sensors[0].count() == 3 && s.sensors[1].count() == 3);
+    assert(s.execute.percentile_ns(0.5) <= s.execute.percentile_ns(1.0));
+    assert(s.execute.percentile_ns(1.0) <= s.execute.max_ns());
+    uint64_t bucketed = 0;
+    for (const auto &[lowest, count] : s.execute.buckets())
+        bucketed += count;
+    assert(bucketed == 3);
+
+    // Rovers on several threads share a recorder, each thread its shard.
+    LatencyRecorder shared(commands, 2, command_tokens);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&] {
+            TimedRover r = make_rover();
+            r.observer().attach(shared);
+            r.land({0, 0}, Direction::EAST);
+            for (int i = 0; i < 100; ++i)
+                r.execute("FR");
+        });
+    }
+    for (std::thread &t : threads)
+        t.join();
+    s = shared.snapshot();
+    assert(s.execute.count() == 400);
+    assert(command(s, "F").count() == 400 && command(s, "R").count() == 400);
+    assert(s.sensors[0].count() == 400 && s.sensors[1].count() == 400);
+    assert(recorder.snapshot().execute.count() == 3);
+
+    // A recorder made where an earlier one was starts empty.
+    for (int i = 0; i < 100; ++i) {
+        auto fresh = std::make_unique<LatencyRecorder>(commands, 2,
+                                                       command_tokens);
+        TimedRover r = make_rover();
+        r.observer().attach(*fresh);
+        r.land({0, 0}, Direction::NORTH);
+        r.execute("F");
+        s = fresh->snapshot();
+        assert(s.execute.count() == 1 && command(s, "F").count() == 1);
+    }
+    return 0;
+}
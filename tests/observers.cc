@@ -0,0 +1,133 @@
+#include <cassert>
+#include <memory>
+#include <sstream>
+#include <vector>
+#include "../observers.h"
+
+struct TrueSensor : public Sensor {
+    bool is_safe([[maybe_unused]] coordinate_t x,
+                 [[maybe_unused]] coordinate_t y) override {
+        return true;
+    }
+};
+
+// Fields from y = 3 on are dangerous.
+struct Wall : public Sensor {
+    bool is_safe([[maybe_unused]] coordinate_t x, coordinate_t y) override {
+        return y < 3;
+    }
+};
+
+struct Counted : DefaultRoverPolicy {
+    using observer_type = CountingObserver;
+};
+
+struct Traced : DefaultRoverPolicy {
+    using observer_type = TraceObserver<>;
+};
+
+struct ShortTrace : DefaultRoverPolicy {
+    using observer_type = TraceObserver<4>;
+};
+
+// One execute in four is timed, the latest two kept.
+struct Sampled : DefaultRoverPolicy {
+    using observer_type = SampledLatencyObserver<2, 2>;
+};
+
+RoverBuilder builder() {
+    RoverBuilder result;
+    result.program_command('F', move_forward())
+          .program_command('R', rotate_right())
+          .program_command("F5", repeat(5, move_forward()))
+          .add_sensor(std::make_unique<TrueSensor>())
+          .add_sensor(std::make_unique<Wall>());
+    return result;
+}
+
+// Three steps north into the wall, then five east by a segment query,
+// then an unknown command.
+template <class R>
+void drive(R &rover) {
+    rover.land({0, 0}, Direction::NORTH);
+    rover.execute("FFF");
+    rover.execute("RF5X");
+    rover.execute("X");
+}
+
+int main() {
+    auto counted = builder().build<Counted>();
+    drive(counted);
+    const CountingObserver &counts = counted.observer();
+    assert(counts.lands == 1 && counts.executes == 3);
+    assert(counts.commands == 5);
+    // Both sensors are asked about the three fields north, the wall
+    // refusing the last one.
+    assert(counts.probes == 6 && counts.unsafe_probes == 1);
+    assert(counts.runs == 2 && counts.run_fields == 10);
+    assert((counts.sensor_queries == std::vector<uint64_t>{4, 4}));
+    assert(counts.stops[static_cast<size_t>(StopReason::DANGEROUS_FIELD)] == 1);
+    assert(counts.stops[static_cast<size_t>(StopReason::UNKNOWN_COMMAND)] == 2);
+    assert(counts.stops[static_cast<size_t>(StopReason::NONE)] == 0);
+
+    auto traced = builder().build<Traced>();
+    drive(traced);
+    using Kind = TraceEvent::Kind;
+    std::vector<TraceEvent> events = traced.observer().events();
+    std::vector<Kind> kinds;
+    for (const TraceEvent &e : events)
+        kinds.push_back(e.kind);
+    assert((kinds == std::vector<Kind>{
+            Kind::LAND,
+            Kind::EXECUTE_BEGIN,
+            Kind::DISPATCH, Kind::PROBE, Kind::PROBE,
+            Kind::DISPATCH, Kind::PROBE, Kind::PROBE,
+            Kind::DISPATCH, Kind::PROBE, Kind::PROBE,
+            Kind::STOP, Kind::EXECUTE_END,
+            Kind::EXECUTE_BEGIN,
+            Kind::DISPATCH, Kind::DISPATCH, Kind::RUN, Kind::RUN,
+            Kind::STOP, Kind::EXECUTE_END,
+            Kind::EXECUTE_BEGIN, Kind::STOP, Kind::EXECUTE_END}));
+    assert(traced.observer().size() == events.size());
+    std::stringstream s;
+    s << events[10] << "; " << events[11] << "; " << events[15] << "; "
+      << events[17];
+    assert(s.str() == "probe sensor 1 (0, 3) 0; stop (0, 2) 1; dispatch F5; "
+                      "run sensor 1 (0, 2) 5");
+
+    // A short ring keeps the latest events, oldest first.
+    auto short_trace = builder().build<ShortTrace>();
+    drive(short_trace);
+    std::vector<TraceEvent> latest = short_trace.observer().events();
+    assert(short_trace.observer().size() == events.size());
+    assert(latest.size() == 4);
+    for (size_t i = 0; i < 4; ++i)
+        assert(latest[i].kind == events[events.size() - 4 + i].kind);
+    short_trace.observer().clear();
+    assert(short_trace.observer().size() == 0);
+    assert(short_trace.observer().events().empty());
+
+    // Executes 0, 4 and 8 of ten are timed.
+    auto sampled = builder().build<Sampled>();
+    sampled.land({0, 0}, Direction::NORTH);
+    for (int i = 0; i < 10; ++i)
+        sampled.execute("RF");
+    const auto &latency = sampled.observer();
+    assert(latency.sample_count() == 3);
+    assert(latency.samples().size() == 2);
+    for (uint64_t ns : latency.samples())
+        assert(ns <= latency.max_ns());
+    assert(latency.mean_ns() <= static_cast<double>(latency.max_ns()));
+
+    // Rovers holding their sensors by value are observed alike.
+    auto by_value = BasicRoverBuilder<>()
+            .program_command('F', move_forward())
+            .add_sensor(Wall())
+            .build<Counted>();
+    by_value.land({0, 0}, Direction::NORTH);
+    by_value.execute("FFFF");
+    assert(by_value.observer().commands == 3);
+    assert(by_value.observer().unsafe_probes == 1);
+    assert(by_value.stop_reason() == StopReason::DANGEROUS_FIELD);
+    return 0;
+}
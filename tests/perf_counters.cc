@@ -0,0 +1,89 @@
+#include <cassert>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../perf_counters.h"
+
+struct TrueSensor : public Sensor {
+    bool is_safe([[maybe_unused]] coordinate_t x,
+                 [[maybe_unused]] coordinate_t y) override {
+        return true;
+    }
+};
+
+struct Profiled : DefaultRoverPolicy {
+    using observer_type = PerfObserver<1>;
+};
+
+std::string printed(const PerfReport &report) {
+    std::stringstream s;
+    s << report;
+    return s.str();
+}
+
+int main() {
+    // Counters that cannot be opened read nothing.
+    PerfCounterGroup group;
+    assert(group.available() || group.read().counted == 0);
+
+    // Metrics need both of their events, and some of the whole.
+    PerfCounts counts;
+    assert(!counts.ipc() && !counts.cache_miss_rate());
+    counts.intervals = 2;
+    counts.totals.values = {400, 100, 50, 0, 10, 1};
+    counts.totals.counted = 0b110011;
+    assert(counts.ipc() == 0.25);
+    assert(!counts.cache_miss_rate());
+    assert(counts.branch_miss_rate() == 0.1);
+    counts.totals.values[static_cast<size_t>(PerfEvent::CYCLES)] = 0;
+    assert(!counts.ipc());
+
+    PerfReport report;
+    assert(printed(report) == "hardware counters unavailable\n");
+    report.available = true;
+    assert(printed(report).empty());
+    report.phases[static_cast<size_t>(PerfPhase::SENSORS)] = counts;
+    assert(printed(report) == "sensors: 2 intervals, 0 cycles, 100 "
+                              "instructions, ipc -, cache miss rate -, "
+                              "branch miss rate 0.1\n");
+
+    // One execute in two is profiled, on whatever counters this machine
+    // lets us open. Without any, or when the kernel never schedules them,
+    // nothing is counted and the report says so.
+    bool available = PerfCounterGroup().available();
+    PerfProfile profile;
+    auto rover = RoverBuilder()
+            .program_command('F', move_forward())
+            .program_command('R', rotate_right())
+            .add_sensor(std::make_unique<TrueSensor>())
+            .build<Profiled>();
+    rover.land({0, 0}, Direction::NORTH);
+    rover.execute("F");
+    rover.observer().attach(profile);
+    for (int i = 0; i < 10; ++i)
+        rover.execute("FRF");
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 3; ++t) {
+        threads.emplace_back([&] {
+            PerfProfile::Scope batch(profile, PerfPhase::FLEET);
+        });
+    }
+    for (std::thread &t : threads)
+        t.join();
+    report = profile.report();
+    assert(!report.available || available);
+    if (report.available) {
+        // Intervals the kernel did not count at all are left out.
+        assert(report[PerfPhase::EXECUTE].intervals <= 5);
+        assert(report[PerfPhase::SENSORS].intervals <= 10);
+        assert(report[PerfPhase::FLEET].intervals <= 3);
+    }
+    else {
+        for (const PerfCounts &c : report.phases)
+            assert(c.intervals == 0 && c.totals.counted == 0);
+        assert(printed(report) == "hardware counters unavailable\n");
+    }
+    return 0;
+}
@@ -0,0 +1,146 @@
+#include <cassert>
+#include <climits>
+#include <memory>
+#include <sstream>
+#include "../binary_commands.h"
+
+// Differences between the engines and the reference rover found by the
+// differential tester, each on a case of its own.
+
+struct TrueSensor : public Sensor {
+    bool is_safe([[maybe_unused]] coordinate_t x,
+                 [[maybe_unused]] coordinate_t y) override {
+        return true;
+    }
+};
+
+// Only the field (0, y) is dangerous.
+struct Hole : public Sensor {
+    coordinate_t y;
+
+    explicit Hole(coordinate_t y) : y(y) {}
+
+    bool is_safe(coordinate_t x, coordinate_t y_) override {
+        return x != 0 || y_ != y;
+    }
+};
+
+// A move the program does not lower, run through the virtual interface.
+struct Step : public MoveForward {};
+
+struct Stop : DefaultRoverPolicy {
+    constexpr static Overflow overflow = Overflow::STOP;
+};
+
+template <class R>
+std::string at(const R &rover) {
+    std::stringstream s;
+    s << rover;
+    return s.str();
+}
+
+// Repeated moves wrap around the edge of the coordinates like single
+// moves do, and stop in front of a dangerous field past it.
+void repeat_across_edge() {
+    commands_t commands = {{'F', move_forward()},
+                           {'R', repeat(5, move_forward())}};
+    Rover single(commands, sensors_t{std::make_shared<TrueSensor>()});
+    Rover repeated(commands, sensors_t{std::make_shared<TrueSensor>()});
+    single.land({0, INT32_MAX - 1}, Direction::NORTH);
+    repeated.land({0, INT32_MAX - 1}, Direction::NORTH);
+    single.execute("FFFFF");
+    repeated.execute("R");
+    assert(at(repeated) == at(single));
+    assert(repeated.stop_reason() == StopReason::NONE);
+
+    Rover blocked(commands, sensors_t{std::make_shared<Hole>(INT32_MIN + 1)});
+    blocked.land({0, INT32_MAX - 1}, Direction::NORTH);
+    blocked.execute("R");
+    std::stringstream expected;
+    expected << Position({0, INT32_MIN}, Direction::NORTH) << " stopped";
+    assert(at(blocked) == expected.str());
+    assert(blocked.stop_reason() == StopReason::DANGEROUS_FIELD);
+}
+
+// A custom action refused by the range of a rover stopping at the edge
+// stops it out of range, like the lowered moves.
+void custom_out_of_range() {
+    commands_t commands = {{'F', move_forward()},
+                           {'S', std::make_shared<Step>()}};
+    PolicyRover<Stop, sensors_t> rover(
+            commands, sensors_t{std::make_shared<TrueSensor>()});
+    rover.land({0, INT32_MAX - 2}, Direction::NORTH);
+    rover.execute("SS");
+    assert(rover.stop_reason() == StopReason::OUT_OF_RANGE);
+    rover.land({0, INT32_MAX - 2}, Direction::NORTH);
+    rover.execute("FF");
+    assert(rover.stop_reason() == StopReason::OUT_OF_RANGE);
+
+    PolicyRover<Stop, sensors_t> walled(
+            commands, sensors_t{std::make_shared<Hole>(1)});
+    walled.land({0, 0}, Direction::NORTH);
+    walled.execute("S");
+    assert(walled.stop_reason() == StopReason::DANGEROUS_FIELD);
+}
+
+// A move_until_unsafe ending in front of a dangerous field does not stop
+// the rover: the command after it does.
+void until_unsafe_then_unknown() {
+    commands_t commands = {{'U', move_until_unsafe(10)}};
+    Rover rover(commands, sensors_t{std::make_shared<Hole>(3)});
+    rover.land({0, 0}, Direction::NORTH);
+    rover.execute(BinaryCommands::encode("UX"));
+    assert(rover.stop_reason() == StopReason::UNKNOWN_COMMAND);
+    rover.land({0, 0}, Direction::NORTH);
+    rover.execute("UX");
+    assert(rover.stop_reason() == StopReason::UNKNOWN_COMMAND);
+    rover.land({0, 0}, Direction::NORTH);
+    rover.execute(BinaryCommands::encode("UU"));
+    assert(rover.stop_reason() == StopReason::NONE);
+    std::stringstream expected;
+    expected << Position({0, 2}, Direction::NORTH);
+    assert(at(rover) == expected.str());
+}
+
+// A move_until_unsafe wraps around the edge of the coordinates like the
+// single moves it stands for, in text and binary lists alike, and keeps
+// in front of a dangerous field past it without stopping.
+void until_unsafe_across_edge() {
+    commands_t commands = {{'F', move_forward()},
+                           {'U', move_until_unsafe(5)}};
+    Rover single(commands, sensors_t{std::make_shared<TrueSensor>()});
+    Rover until(commands, sensors_t{std::make_shared<TrueSensor>()});
+    single.land({0, INT32_MAX - 1}, Direction::NORTH);
+    single.execute("FFFFF");
+    until.land({0, INT32_MAX - 1}, Direction::NORTH);
+    until.execute("U");
+    assert(at(until) == at(single));
+    until.land({0, INT32_MAX - 1}, Direction::NORTH);
+    until.execute(BinaryCommands::encode("U"));
+    assert(at(until) == at(single));
+
+    Rover blocked(commands, sensors_t{std::make_shared<Hole>(INT32_MIN + 1)});
+    blocked.land({0, INT32_MAX - 1}, Direction::NORTH);
+    blocked.execute(BinaryCommands::encode("UX"));
+    std::stringstream expected;
+    expected << Position({0, INT32_MIN}, Direction::NORTH) << " stopped";
+    assert(at(blocked) == expected.str());
+    assert(blocked.stop_reason() == StopReason::UNKNOWN_COMMAND);
+
+    // Stopping at the edge, the rover keeps in range.
+    PolicyRover<Stop, sensors_t> ranged(
+            commands, sensors_t{std::make_shared<TrueSensor>()});
+    ranged.land({0, INT32_MAX - 3}, Direction::NORTH);
+    ranged.execute("U");
+    std::stringstream in_range;
+    in_range << Position({0, INT32_MAX - 1}, Direction::NORTH);
+    assert(at(ranged) == in_range.str());
+}
+
+int main() {
+    repeat_across_edge();
+    custom_out_of_range();
+    until_unsafe_then_unknown();
+    until_unsafe_across_edge();
+    return 0;
+}
@@ -0,0 +1,137 @@
+#include <cassert>
+#include <memory>
+#include <sstream>
+#include "../rover.h"
+
+// Counts the questions reaching it; (20, 0) is dangerous.
+struct CountingSensor : public Sensor {
+    uint64_t calls = 0;
+
+    bool is_safe(coordinate_t x, coordinate_t y) override {
+        ++calls;
+        return !(x == 20 && y == 0);
+    }
+};
+
+// Walls along x = 5000 and y = 5000, counting cells and segments asked
+// about. Segments going north or east are answered at once.
+struct WallSensor : public Sensor {
+    uint64_t cells = 0, runs = 0;
+
+    bool is_safe(coordinate_t x, coordinate_t y) override {
+        ++cells;
+        return x != 5000 && y != 5000;
+    }
+
+    coordinate_t safe_run(coordinate_t x, coordinate_t y, Direction d,
+                          coordinate_t limit) override {
+        ++runs;
+        int64_t free = limit;
+        if (d == Direction::NORTH && y < 5000)
+            free = std::min<int64_t>(free, 4999 - y);
+        if (d == Direction::EAST && x < 5000)
+            free = std::min<int64_t>(free, 4999 - x);
+        return static_cast<coordinate_t>(x == 5000 ? 0 : free);
+    }
+};
+
+std::string get_string_in_ostream(const auto &rover) {
+    std::stringstream s;
+    s << rover;
+    return s.str();
+}
+
+int main() {
+    auto world = std::make_shared<WorldVersion>();
+    auto sensor = std::make_unique<CountingSensor>();
+    CountingSensor &counted = *sensor;
+    auto rover = RoverBuilder()
+            .program_command('F', move_forward())
+            .program_command('B', move_backward())
+            .program_command('R', rotate_right())
+            .program_command('L', rotate_left())
+            .add_sensor(std::move(sensor))
+            .cache_safe_region(world)
+            .build();
+
+    // Fresh cells are asked about once each, never a whole row at a time.
+    rover.land({0, 0}, Direction::NORTH);
+    rover.execute(std::string(50, 'F'));
+    assert(get_string_in_ostream(rover) == "(0, 50) NORTH");
+    assert(counted.calls == 50);
+
+    // Moves inside the window, 64 rows high, do not reach the sensor.
+    rover.execute(std::string(50, 'B'));
+    assert(get_string_in_ostream(rover) == "(0, 0) NORTH");
+    // Only the landing field was never asked about.
+    assert(counted.calls == 51);
+
+    // Moving east slides the window: a row is recentred on the rover once
+    // it leaves it, and only the cells entered are asked about.
+    rover.execute("R" + std::string(19, 'F'));
+    assert(get_string_in_ostream(rover) == "(19, 0) EAST");
+    assert(counted.calls == 70);
+    rover.execute("F");
+    assert(get_string_in_ostream(rover) == "(19, 0) EAST stopped");
+    assert(counted.calls == 71);
+    rover.land({21, 0}, Direction::EAST);
+    rover.execute(std::string(200, 'F'));
+    assert(get_string_in_ostream(rover) == "(221, 0) EAST");
+    assert(counted.calls == 271);
+    rover.execute("RR" + std::string(200, 'F'));
+    assert(get_string_in_ostream(rover) == "(21, 0) WEST");
+    // The row around x = 221 replaced the one around the start, whose
+    // cells are asked about again.
+    assert(counted.calls > 271 && counted.calls <= 471);
+
+    // Bumping the world version drops every verdict.
+    rover.land({100, 40}, Direction::EAST);
+    rover.execute(std::string(10, 'F') + "RR" + std::string(10, 'F'));
+    assert(get_string_in_ostream(rover) == "(100, 40) WEST");
+    uint64_t before = counted.calls;
+    rover.execute("RR" + std::string(10, 'F'));
+    assert(counted.calls == before);
+    world->bump();
+    rover.execute("RR" + std::string(10, 'F'));
+    assert(get_string_in_ostream(rover) == "(100, 40) WEST");
+    assert(counted.calls == before + 10);
+
+    // Batch queries fill the span they cover and agree with the sensor.
+    auto direct = std::make_shared<CountingSensor>();
+    SafeRegionCache cache({direct});
+    assert(cache.safe_row(0, 0, 32) == (0xffffffff & ~(uint64_t{1} << 20)));
+    uint64_t calls = direct->calls;
+    for (coordinate_t x = 0; x < 32; ++x)
+        assert(cache.is_safe(x, 0) == (x != 20));
+    assert(direct->calls == calls);
+    assert(!cache.is_safe(20, 0));
+
+    // Long runs reach the sensor as segment queries, not cell by cell,
+    // through the window as well as past it.
+    auto walls = std::make_unique<WallSensor>();
+    WallSensor &wall = *walls;
+    auto runner = RoverBuilder()
+            .program_command('F', move_forward())
+            .program_command('R', rotate_right())
+            .program_command('U', move_until_unsafe(100000))
+            .program_command('N', repeat(10000, move_forward()))
+            .add_sensor(std::move(walls))
+            .cache_safe_region()
+            .build();
+    runner.land({0, 0}, Direction::NORTH);
+    runner.execute("FFFFU");
+    assert(get_string_in_ostream(runner) == "(0, 4999) NORTH");
+    assert(wall.cells == 4 && wall.runs == 1);
+    runner.execute("RFFFFU");
+    assert(get_string_in_ostream(runner) == "(4999, 4999) EAST");
+    // The cells of the row around the rover not asked about yet are
+    // asked about at once.
+    assert(wall.cells <= 8 + 64 && wall.runs <= 2);
+    runner.land({0, 100}, Direction::EAST);
+    uint64_t cells = wall.cells;
+    runner.execute("N");
+    assert(get_string_in_ostream(runner) == "(4999, 100) EAST stopped");
+    // One more cell: the wall the rover stops in front of.
+    assert(wall.cells <= cells + 1 && wall.runs <= 3);
+    return 0;
+}
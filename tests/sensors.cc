@@ -0,0 +1,308 @@
+#include <cassert>
+#include <functional>
+#include <set>
+#include <memory>
+#include <vector>
+#include "../bloom_sensor.h"
+#include "../generator.h"
+#include "../interval_sensor.h"
+#include "../noise_sensor.h"
+#include "../rtree_sensor.h"
+
+using Truth = std::function<bool(coordinate_t, coordinate_t)>;
+
+// Fields near one of the anchors.
+coordinate_t near(SplitMix64 &random, coordinate_t anchor, uint32_t radius) {
+    int64_t c = int64_t{anchor} - radius + random.below(2 * radius + 1);
+    return static_cast<coordinate_t>(
+            std::clamp<int64_t>(c, INT32_MIN, INT32_MAX));
+}
+
+// Checks the sensor's point, row and segment queries against the truth
+// about each field, asked one by one.
+void check(Sensor &sensor, const Truth &dangerous,
+           const std::vector<std::pair<coordinate_t, coordinate_t>> &anchors,
+           uint64_t seed) {
+    SplitMix64 random(seed);
+    for (int i = 0; i < 3000; ++i) {
+        auto [ax, ay] = anchors[random.below(
+                static_cast<uint32_t>(anchors.size()))];
+        coordinate_t x = near(random, ax, 80), y = near(random, ay, 80);
+        assert(sensor.is_safe(x, y) == !dangerous(x, y));
+
+        auto width = static_cast<int>(1 + random.below(64));
+        uint64_t row = sensor.safe_row(x, y, width);
+        for (int k = 0; k < 64; ++k) {
+            bool safe = k < width && !dangerous(wrapping_add(x, k), y);
+            assert((row >> k & 1) == safe);
+        }
+
+        auto d = static_cast<Direction>(random.below(4));
+        auto limit = static_cast<coordinate_t>(random.below(200));
+        coordinate_t dx = DirectionManager::get_dx(d);
+        coordinate_t dy = DirectionManager::get_dy(d);
+        coordinate_t free = 0;
+        int64_t cx = x, cy = y;
+        while (free < limit) {
+            cx += dx;
+            cy += dy;
+            if (cx < INT32_MIN || cx > INT32_MAX || cy < INT32_MIN ||
+                    cy > INT32_MAX || dangerous(static_cast<coordinate_t>(cx),
+                                                static_cast<coordinate_t>(cy)))
+                break;
+            ++free;
+        }
+        assert(sensor.safe_run(x, y, d, limit) == free);
+    }
+}
+
+const std::vector<std::pair<coordinate_t, coordinate_t>> ANCHORS = {
+    {0, 0}, {INT32_MAX, INT32_MAX}, {INT32_MIN, INT32_MAX},
+    {INT32_MIN, INT32_MIN}, {INT32_MAX, 0},
+};
+
+// Rectangles and small polygons around the anchors.
+void rtree(uint64_t seed) {
+    SplitMix64 random(seed);
+    std::vector<HazardRect> rectangles;
+    std::vector<HazardPolygon> polygons;
+    for (auto [ax, ay] : ANCHORS) {
+        for (int i = 0; i < 40; ++i) {
+            coordinate_t x = near(random, ax, 80), y = near(random, ay, 80);
+            rectangles.push_back({x, y, near(random, x, 6), near(random, y, 6)});
+        }
+        for (int i = 0; i < 10; ++i) {
+            coordinate_t x = near(random, ax, 80), y = near(random, ay, 80);
+            HazardPolygon polygon;
+            for (uint32_t v = 3 + random.below(4); v > 0; --v)
+                polygon.vertices.emplace_back(near(random, x, 12),
+                                              near(random, y, 12));
+            polygons.push_back(polygon);
+        }
+    }
+    // Even-odd rule with boundary points inside, in exact 64-bit
+    // arithmetic: the polygons are small.
+    auto in_polygon = [](const HazardPolygon &polygon, int64_t px,
+                         int64_t py) {
+        const auto &v = polygon.vertices;
+        bool in = false;
+        for (size_t i = 0, j = v.size() - 1; i < v.size(); j = i++) {
+            int64_t xi = v[i].first, yi = v[i].second;
+            int64_t xj = v[j].first, yj = v[j].second;
+            int64_t cross = (xj - xi) * (py - yi) - (yj - yi) * (px - xi);
+            if (cross == 0 && std::min(xi, xj) <= px &&
+                    px <= std::max(xi, xj) && std::min(yi, yj) <= py &&
+                    py <= std::max(yi, yj))
+                return true;
+            if ((yi > py) != (yj > py) && (cross > 0) == (yj > yi))
+                in = !in;
+        }
+        return in;
+    };
+    Truth dangerous = [&](coordinate_t x, coordinate_t y) {
+        for (const auto &r : rectangles) {
+            if (std::min(r.x0, r.x1) <= x && x <= std::max(r.x0, r.x1) &&
+                    std::min(r.y0, r.y1) <= y && y <= std::max(r.y0, r.y1))
+                return true;
+        }
+        for (const auto &polygon : polygons) {
+            if (in_polygon(polygon, x, y))
+                return true;
+        }
+        return false;
+    };
+    RTreeSensor sensor(rectangles, polygons);
+    check(sensor, dangerous, ANCHORS, seed);
+
+    // A triangle as large as the map, whose edge products overflow 64
+    // bits: its hypotenuse is the line x + y = -1.
+    RTreeSensor huge({}, {{{{INT32_MIN, INT32_MIN}, {INT32_MAX, INT32_MIN},
+                            {INT32_MIN, INT32_MAX}}}});
+    check(huge, [](coordinate_t x, coordinate_t y) {
+        return int64_t{x} + y <= -1;
+    }, ANCHORS, seed);
+    // Runs across it are worked out from its edges, not cell by cell.
+    constexpr coordinate_t FAR = 1 << 30;
+    assert(huge.safe_run(FAR / 2, FAR / 2, Direction::SOUTH, INT32_MAX) ==
+           FAR);
+    assert(huge.safe_run(FAR, 0, Direction::WEST, INT32_MAX) == FAR);
+    assert(huge.safe_run(FAR, 0, Direction::WEST, 1000) == 1000);
+    assert(huge.safe_run(-FAR, 5, Direction::EAST, INT32_MAX) == 0);
+    assert(huge.safe_run(INT32_MAX, 0, Direction::SOUTH, INT32_MAX) ==
+           INT32_MAX);
+
+    // A U open to the north: runs and rows cross its arms and the gap
+    // between them.
+    RTreeSensor u({}, {{{{0, 0}, {9, 0}, {9, 9}, {6, 9}, {6, 3}, {3, 3},
+                         {3, 9}, {0, 9}}}});
+    assert(u.safe_run(-5, 5, Direction::EAST, 100) == 4);
+    assert(u.safe_run(4, 5, Direction::EAST, 100) == 1);
+    assert(u.safe_run(5, 5, Direction::WEST, 100) == 1);
+    assert(u.safe_run(4, 20, Direction::SOUTH, 100) == 16);
+    assert(u.safe_run(3, 20, Direction::SOUTH, 100) == 10);
+    assert(u.safe_run(4, -1, Direction::NORTH, 100) == 0);
+    assert(u.safe_row(-2, 5, 14) == (0b11u | 0b11u << 6 | 0b11u << 12));
+    assert(u.safe_row(-2, 2, 14) == (0b11u | 0b11u << 12));
+}
+
+// Spans on a few rows around the anchors, overlapping and touching,
+// some reaching the ends of their row.
+void interval(uint64_t seed) {
+    SplitMix64 random(seed);
+    std::vector<HazardSpan> spans;
+    for (auto [ax, ay] : ANCHORS) {
+        for (int i = 0; i < 80; ++i) {
+            coordinate_t x = near(random, ax, 80);
+            spans.push_back({near(random, ay, 30), x, near(random, x, 16)});
+        }
+    }
+    spans.push_back({0, INT32_MIN, INT32_MIN});
+    spans.push_back({1, INT32_MAX, INT32_MAX});
+    Truth dangerous = [&](coordinate_t x, coordinate_t y) {
+        for (const auto &span : spans) {
+            if (span.y == y && std::min(span.x0, span.x1) <= x &&
+                    x <= std::max(span.x0, span.x1))
+                return true;
+        }
+        return false;
+    };
+    IntervalSensor sensor(spans);
+    check(sensor, dangerous, ANCHORS, seed);
+
+    // A row dangerous from end to end.
+    IntervalSensor wall({{5, INT32_MIN, -1}, {5, 0, INT32_MAX}});
+    assert(wall.safe_row(INT32_MIN, 5, 64) == 0);
+    assert(wall.safe_row(-32, 5, 64) == 0);
+    assert(wall.safe_run(0, 0, Direction::NORTH, 100) == 4);
+    assert(wall.safe_run(0, 5, Direction::EAST, 100) == 0);
+    assert(wall.safe_run(0, 6, Direction::EAST, 100) == 100);
+}
+
+// Noise of every scale, its rows and segments checked against its own
+// fields.
+void noise(uint64_t seed) {
+    SplitMix64 random(seed);
+    auto scale_log2 = random.below(9);
+    auto threshold = random.below(160);
+    NoiseSensor sensor(static_cast<uint32_t>(random.next()), scale_log2,
+                       threshold);
+    NoiseSensor fields = sensor;
+    check(sensor, [&](coordinate_t x, coordinate_t y) {
+        return !fields.is_safe(x, y);
+    }, ANCHORS, seed);
+
+    // Noise values are below 256.
+    NoiseSensor flat(static_cast<uint32_t>(seed), scale_log2, 0);
+    check(flat, [](coordinate_t, coordinate_t) { return false; }, ANCHORS,
+          seed);
+    NoiseSensor sea(static_cast<uint32_t>(seed), scale_log2, 256);
+    check(sea, [](coordinate_t, coordinate_t) { return true; }, ANCHORS, seed);
+}
+
+using cells_t = std::set<std::pair<coordinate_t, coordinate_t>>;
+
+// Dangerous cells, looked up one by one.
+struct Cells : public Sensor {
+    cells_t dangerous;
+
+    Cells(cells_t dangerous_) : dangerous(std::move(dangerous_)) {}
+
+    bool is_safe(coordinate_t x, coordinate_t y) override {
+        return !dangerous.contains({x, y});
+    }
+};
+
+// A small filter of the dangerous cells and of safe decoys, which fall
+// through to the exact sensor.
+void bloom(uint64_t seed) {
+    SplitMix64 random(seed);
+    cells_t dangerous;
+    std::vector<std::pair<coordinate_t, coordinate_t>> listed;
+    for (auto [ax, ay] : ANCHORS) {
+        for (int i = 0; i < 1000; ++i) {
+            std::pair<coordinate_t, coordinate_t> cell = {
+                    near(random, ax, 80), near(random, ay, 80)};
+            if (random.below(2) == 0)
+                dangerous.insert(cell);
+            listed.push_back(cell);
+        }
+    }
+    double bits_per_hazard = 1 + random.below(8);
+    BloomSensor sensor(std::make_shared<Cells>(dangerous), listed,
+                       bits_per_hazard);
+    check(sensor, [&](coordinate_t x, coordinate_t y) {
+        return dangerous.contains({x, y});
+    }, ANCHORS, seed);
+
+    // Every listed cell falls through, the dangerous ones among the rest.
+    uint64_t queries = sensor.query_count();
+    uint64_t fall_throughs = sensor.fall_through_count();
+    for (auto [x, y] : listed)
+        assert(sensor.is_safe(x, y) == !dangerous.contains({x, y}));
+    assert(sensor.query_count() == queries + listed.size());
+    assert(sensor.fall_through_count() == fall_throughs + listed.size());
+    assert(sensor.false_positive_rate() > 0 &&
+           sensor.false_positive_rate() <= 1);
+}
+
+// A run stopped by a hazard asks the exact sensor about no cell past it.
+void bloom_stops_at_hazard() {
+    struct Farthest : public Sensor {
+        coordinate_t farthest = INT32_MIN;
+
+        bool is_safe(coordinate_t x, coordinate_t y) override {
+            farthest = std::max(farthest, x);
+            return x < 5 || y != 0;
+        }
+    };
+    auto exact = std::make_shared<Farthest>();
+    std::vector<std::pair<coordinate_t, coordinate_t>> hazards;
+    for (coordinate_t x = 5; x < 100; ++x)
+        hazards.emplace_back(x, 0);
+    BloomSensor sensor(exact, hazards);
+    assert(sensor.safe_run(0, 0, Direction::EAST, 1000) == 4);
+    assert(sensor.query_count() == 5);
+    assert(exact->farthest == 5);
+    assert(sensor.safe_run(200, 0, Direction::WEST, 1000) == 100);
+    assert(sensor.query_count() == 5 + 101);
+}
+
+// Rows reaching past INT32_MAX go on from INT32_MIN, by default, through
+// a Bloom filter and in the indexes of hazards.
+void wrapping_rows() {
+    struct Holes : public Sensor {
+        bool is_safe(coordinate_t x, [[maybe_unused]] coordinate_t y) override {
+            return x != INT32_MAX - 5 && x != INT32_MIN + 1;
+        }
+    };
+    auto holes = std::make_shared<Holes>();
+    BloomSensor bloom(holes, {{INT32_MAX - 5, 0}, {INT32_MIN + 1, 0}});
+    for (Sensor *sensor : {static_cast<Sensor *>(holes.get()),
+                           static_cast<Sensor *>(&bloom)}) {
+        uint64_t row = sensor->safe_row(INT32_MAX - 10, 0, 64);
+        assert(row == ~(uint64_t{1} << 5 | uint64_t{1} << 12));
+        assert(sensor->safe_row(INT32_MAX - 10, 0, 12) == 0xfdf);
+    }
+
+    RTreeSensor rtree({{INT32_MIN + 5, 0, INT32_MIN + 5, 0}});
+    IntervalSensor interval({{0, INT32_MIN + 5, INT32_MIN + 5}});
+    for (Sensor *sensor : {static_cast<Sensor *>(&rtree),
+                           static_cast<Sensor *>(&interval)}) {
+        assert(!sensor->is_safe(INT32_MIN + 5, 0));
+        assert(sensor->safe_row(INT32_MAX - 10, 0, 64) ==
+               ~(uint64_t{1} << 16));
+        assert(sensor->safe_row(INT32_MAX - 10, 0, 16) == 0xffff);
+    }
+}
+
+int main() {
+    wrapping_rows();
+    bloom_stops_at_hazard();
+    for (uint64_t seed = 1; seed <= 20; ++seed) {
+        rtree(seed);
+        interval(seed);
+        noise(seed);
+        bloom(seed);
+    }
+    return 0;
+}
@@ -0,0 +1,109 @@
+#include <cassert>
+#include <memory>
+#include <sstream>
+#include <string>
+#include "../generator.h"
+#include "../static_program.h"
+
+constexpr StaticCommand table[] = {
+    {'F', "F"}, {'B', "B"}, {'L', "L"}, {'R', "R"},
+    {'U', "RR"}, {'S', "FFRFF"},
+};
+
+// Traced at compile time for a rover heading north.
+using Patrol = StaticProgram<"FFUFF", table>;
+static_assert(Patrol::dx == 0 && Patrol::dy == 0);
+static_assert(Patrol::turns == 2 && Patrol::probes == 4 && !Patrol::stops);
+
+using Square = StaticProgram<"FRFRFRF", table>;
+static_assert(Square::dx == 0 && Square::dy == 0);
+static_assert(Square::turns == 3 && Square::probes == 4);
+
+using Step = StaticProgram<"S", table>;
+static_assert(Step::dx == 2 && Step::dy == 2);
+static_assert(Step::turns == 1 && Step::probes == 4);
+
+using Back = StaticProgram<"BL", table>;
+static_assert(Back::dx == 0 && Back::dy == -1);
+static_assert(Back::turns == 3 && Back::probes == 1);
+
+// The rover stops at 'X', which the table lacks.
+using Unknown = StaticProgram<"FXF", table>;
+static_assert(Unknown::stops && Unknown::dy == 1 && Unknown::probes == 1);
+
+using Nothing = StaticProgram<"", table>;
+static_assert(Nothing::dx == 0 && Nothing::dy == 0 && Nothing::probes == 0);
+
+std::string get_string_in_ostream(const auto &rover) {
+    std::stringstream s;
+    s << rover;
+    return s.str();
+}
+
+Rover make_rover(const HazardOptions &world) {
+    return RoverBuilder()
+            .program_command('F', move_forward())
+            .program_command('B', move_backward())
+            .program_command('L', rotate_left())
+            .program_command('R', rotate_right())
+            .program_command('U', compose({rotate_right(), rotate_right()}))
+            .program_command('S', compose({move_forward(), move_forward(),
+                                           rotate_right(), move_forward(),
+                                           move_forward()}))
+            .add_sensor(std::make_unique<GeneratedHazards>(world))
+            .build();
+}
+
+// Runs the compiled list and the same list as text from the same
+// landings, which must end in the same state.
+template <StaticString Commands>
+void agree(const HazardOptions &world, SplitMix64 &random) {
+    using P = StaticProgram<Commands, table>;
+    std::string text(Commands.data, Commands.size());
+    Rover compiled = make_rover(world);
+    Rover interpreted = make_rover(world);
+    for (int i = 0; i < 200; ++i) {
+        // Near the origin, or near the edges of the map, where the
+        // coordinates wrap around.
+        auto near = [&](int64_t c) {
+            return static_cast<coordinate_t>(
+                    static_cast<uint32_t>(c - 8 + random.below(17)));
+        };
+        int64_t anchor = random.below(2) ? 0 : INT32_MAX;
+        Coordinates at(near(anchor), near(anchor));
+        auto heading = static_cast<Direction>(random.below(4));
+        compiled.land(at, heading);
+        interpreted.land(at, heading);
+        for (int repeat = 0; repeat < 3; ++repeat) {
+            compiled.execute(P{});
+            interpreted.execute(text);
+            assert(get_string_in_ostream(compiled) ==
+                   get_string_in_ostream(interpreted));
+            assert(compiled.stop_reason() == interpreted.stop_reason());
+        }
+    }
+}
+
+int main() {
+    SplitMix64 random(1);
+    for (uint64_t seed = 1; seed <= 20; ++seed) {
+        HazardOptions world{.seed = seed, .density = seed % 4 * 0.1};
+        agree<"FFUFF">(world, random);
+        agree<"FRFRFRF">(world, random);
+        agree<"S">(world, random);
+        agree<"BL">(world, random);
+        agree<"FXF">(world, random);
+        agree<"">(world, random);
+        agree<"SSUBBLFFRS">(world, random);
+    }
+
+    // Safe ground: the displacement is rotated to the heading.
+    Rover rover = make_rover({.density = 0});
+    rover.land({10, 10}, Direction::EAST);
+    rover.execute(Step{});
+    assert(get_string_in_ostream(rover) == "(12, 8) SOUTH");
+    rover.execute(Unknown{});
+    assert(get_string_in_ostream(rover) == "(12, 7) SOUTH stopped");
+    assert(rover.stop_reason() == StopReason::UNKNOWN_COMMAND);
+    return 0;
+}
@@ -0,0 +1,141 @@
+#include <cassert>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include "../telemetry.h"
+
+struct TrueSensor : public Sensor {
+    bool is_safe([[maybe_unused]] coordinate_t x,
+                 [[maybe_unused]] coordinate_t y) override {
+        return true;
+    }
+};
+
+struct Monitored : DefaultRoverPolicy {
+    using observer_type = TelemetryObserver;
+};
+
+bool same(const std::optional<TelemetryRecord> &read,
+          const TelemetryRecord &b) {
+    if (!read)
+        return false;
+    const TelemetryRecord &a = *read;
+    return a.x == b.x && a.y == b.y && a.direction == b.direction &&
+           a.landed == b.landed && a.stopped == b.stopped &&
+           a.reason == b.reason && a.executes == b.executes &&
+           a.commands == b.commands && a.stops == b.stops;
+}
+
+template <class F>
+bool throws_out_of_range(F f) {
+    try {
+        f();
+    }
+    catch (std::out_of_range &) {
+        return true;
+    }
+    return false;
+}
+
+template <class F>
+bool throws_unavailable(F f) {
+    try {
+        f();
+    }
+    catch (TelemetryUnavailable &) {
+        return true;
+    }
+    return false;
+}
+
+int main() {
+    std::string name = "/rover_telemetry_test_" + std::to_string(getpid());
+    TelemetryRegion region(name, 4);
+    TelemetryRegion monitor(name);
+    assert(region.size() == 4 && monitor.size() == 4);
+
+    // Slots start zeroed and read back what was published.
+    assert(same(monitor.read(3), TelemetryRecord{}));
+    TelemetryRecord record{.x = -7, .y = INT32_MAX, .direction = Direction::WEST,
+                           .landed = true, .stopped = true,
+                           .reason = StopReason::DANGEROUS_FIELD,
+                           .executes = 5, .commands = 1u << 20,
+                           .stops = UINT64_MAX};
+    region.publish(2, record);
+    assert(same(region.read(2), record));
+    assert(same(monitor.read(2), record));
+    assert(same(monitor.read(1), TelemetryRecord{}));
+
+    assert(throws_out_of_range([&] { region.publish(4, record); }));
+    assert(throws_out_of_range([&] { monitor.read(4); }));
+    assert(throws_out_of_range([&] { monitor.read(SIZE_MAX); }));
+
+    auto rover = RoverBuilder()
+            .program_command('F', move_forward())
+            .program_command('R', rotate_right())
+            .add_sensor(std::make_unique<TrueSensor>())
+            .build<Monitored>();
+    assert(throws_out_of_range([&] { rover.observer().attach(region, 4); }));
+    rover.observer().attach(region, 0);
+    rover.land({1, 1}, Direction::NORTH);
+    TelemetryRecord landed = *monitor.read(0);
+    assert(landed.landed && !landed.stopped && landed.x == 1 && landed.y == 1);
+    rover.execute("FFRFX");
+    TelemetryRecord r = *monitor.read(0);
+    assert(r.x == 2 && r.y == 3 && r.direction == Direction::EAST);
+    assert(r.stopped && r.reason == StopReason::UNKNOWN_COMMAND);
+    assert(r.executes == 1 && r.commands == 4 && r.stops == 1);
+    assert(same(monitor.read(2), record));
+
+    // Readers never see a slot half written.
+    std::atomic<bool> done = false;
+    std::thread writer([&] {
+        TelemetryRecord w;
+        for (uint64_t i = 0; i < 200000; ++i) {
+            w.x = w.y = static_cast<coordinate_t>(i);
+            w.executes = w.commands = w.stops = i;
+            region.publish(1, w);
+        }
+        done = true;
+    });
+    while (!done) {
+        std::optional<TelemetryRecord> read = monitor.read(1);
+        if (!read)
+            continue;
+        const TelemetryRecord &seen = *read;
+        assert(seen.x == seen.y && seen.executes == seen.commands &&
+               seen.commands == seen.stops &&
+               static_cast<uint64_t>(seen.x) == seen.executes);
+    }
+    writer.join();
+    assert(monitor.read(1)->stops == 199999);
+
+    // A writer dying halfway through a write leaves its slot's sequence
+    // odd, at the start of the slot: readers give up on it.
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    assert(fd >= 0);
+    size_t length = 64 + 4 * 64;
+    void *memory = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED,
+                        fd, 0);
+    close(fd);
+    assert(memory != MAP_FAILED);
+    auto *sequence = reinterpret_cast<std::atomic<uint32_t> *>(
+            static_cast<char *>(memory) + 64 + 3 * 64);
+    sequence->fetch_add(1);
+    assert(!monitor.read(3));
+    assert(same(monitor.read(2), record));
+    munmap(memory, length);
+
+    // A name in use is not taken over, until removed.
+    assert(throws_unavailable([&] { TelemetryRegion(name, 4); }));
+    std::string stale = name + "_stale";
+    fd = shm_open(stale.c_str(), O_CREAT | O_RDWR, 0644);
+    assert(fd >= 0);
+    close(fd);
+    assert(throws_unavailable([&] { TelemetryRegion(stale, 4); }));
+    TelemetryRegion::remove(stale);
+    TelemetryRegion fresh(stale, 4);
+    assert(same(TelemetryRegion(stale).read(0), TelemetryRecord{}));
+    return 0;
+}
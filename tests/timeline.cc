@@ -0,0 +1,164 @@
+#include <cassert>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../timeline.h"
+
+struct TrueSensor : public Sensor {
+    bool is_safe([[maybe_unused]] coordinate_t x,
+                 [[maybe_unused]] coordinate_t y) override {
+        return true;
+    }
+};
+
+struct Traced : DefaultRoverPolicy {
+    using observer_type = TimelineObserver;
+};
+
+// An event of the trace, as written on a line of its own.
+struct Event {
+    std::string name, cat;
+    size_t tid;
+    double ts, dur;
+};
+
+std::string field(const std::string &line, const std::string &key) {
+    size_t at = line.find("\"" + key + "\":");
+    assert(at != std::string::npos);
+    at += key.size() + 3;
+    if (line[at] == '"')
+        return line.substr(at + 1, line.find('"', at + 1) - at - 1);
+    return line.substr(at, line.find_first_of(",}", at) - at);
+}
+
+std::vector<Event> events(const Timeline &timeline) {
+    std::stringstream s;
+    timeline.write_json(s);
+    std::string line;
+    std::getline(s, line);
+    assert(line == "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    std::vector<Event> result;
+    while (std::getline(s, line) && line != "]}") {
+        result.push_back({field(line, "name"), field(line, "cat"),
+                          std::stoul(field(line, "tid")),
+                          std::stod(field(line, "ts")),
+                          std::stod(field(line, "dur"))});
+    }
+    assert(line == "]}");
+    return result;
+}
+
+size_t count(const std::vector<Event> &trace, const std::string &cat) {
+    size_t n = 0;
+    for (const Event &e : trace)
+        n += e.cat == cat;
+    return n;
+}
+
+// Whether inner lies within outer, up to the microsecond rounding.
+bool within(const Event &inner, const Event &outer) {
+    constexpr double ROUNDING = 0.002;
+    return outer.ts <= inner.ts + ROUNDING &&
+           inner.ts + inner.dur <= outer.ts + outer.dur + ROUNDING;
+}
+
+// Composes nested depth deep, each moving 17 fields of its own so that
+// none is inlined into its parent or jumped over.
+std::shared_ptr<Action> nested(int depth) {
+    std::vector<std::shared_ptr<Action>> moves(17, move_forward());
+    std::shared_ptr<Action> result = compose(moves);
+    for (int i = 1; i < depth; ++i) {
+        std::vector<std::shared_ptr<Action>> body = moves;
+        body.push_back(result);
+        result = compose(body);
+    }
+    return result;
+}
+
+auto make_rover(int depth) {
+    return RoverBuilder()
+            .program_command('F', move_forward())
+            .program_command('N', nested(depth))
+            .add_sensor(std::make_unique<TrueSensor>())
+            .build<Traced>();
+}
+
+// Spans are written as they end: innermost bodies first, then the
+// command and execute holding them.
+void check_nesting(int depth) {
+    Timeline timeline;
+    auto rover = make_rover(depth);
+    rover.land({0, 0}, Direction::NORTH);
+    rover.execute("F");
+    assert(timeline.size() == 0);
+    rover.observer().attach(timeline, 3);
+    rover.execute("FN");
+
+    auto composes = static_cast<size_t>(depth - 1);
+    size_t kept = std::min(composes, TimelineObserver::COMPOSE_DEPTH);
+    std::vector<Event> trace = events(timeline);
+    assert(trace.size() == timeline.size());
+    assert(count(trace, "execute") == 1);
+    assert(count(trace, "command") == 2);
+    assert(count(trace, "sensor") == 17 * static_cast<size_t>(depth) + 1);
+    assert(count(trace, "compose") == kept);
+    assert(trace.size() == 17 * static_cast<size_t>(depth) + 4 + kept);
+
+    const Event &execute = trace.back();
+    const Event &command = trace[trace.size() - 2];
+    assert(execute.cat == "execute" && command.name == "N");
+    assert(within(command, execute));
+    std::vector<Event> bodies;
+    for (const Event &e : trace) {
+        if (e.cat == "compose")
+            bodies.push_back(e);
+        if (e.cat == "sensor" && e.ts >= command.ts)
+            assert(within(e, command));
+    }
+    for (size_t i = 0; i + 1 < bodies.size(); ++i)
+        assert(within(bodies[i], bodies[i + 1]));
+    if (!bodies.empty())
+        assert(within(bodies.back(), command));
+    for (const Event &e : trace)
+        assert(e.tid == 0);
+}
+
+int main() {
+    for (int depth : {1, 2, 3, 16, 17, 18, 30})
+        check_nesting(depth);
+
+    // A deep command leaves nothing behind for the next execute.
+    Timeline timeline;
+    auto rover = make_rover(30);
+    rover.observer().attach(timeline);
+    rover.land({0, 0}, Direction::NORTH);
+    rover.execute("N");
+    rover.execute("NF");
+    std::vector<Event> trace = events(timeline);
+    assert(count(trace, "compose") == 2 * TimelineObserver::COMPOSE_DEPTH);
+    assert(count(trace, "execute") == 2 && count(trace, "command") == 3);
+
+    // Rings keep the latest spans, one ring and trace thread per thread.
+    Timeline small(8);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 2; ++t) {
+        threads.emplace_back([&small] {
+            auto r = make_rover(2);
+            r.observer().attach(small);
+            r.land({0, 0}, Direction::EAST);
+            r.execute("FFFF");
+            Timeline::Batch batch(small, 1);
+        });
+    }
+    for (std::thread &t : threads)
+        t.join();
+    assert(small.size() == 2 * (4 + 4 + 1 + 1));
+    trace = events(small);
+    assert(trace.size() == 16);
+    assert(count(trace, "fleet batch") == 2 && count(trace, "execute") == 2);
+    for (size_t i = 0; i < trace.size(); ++i)
+        assert(trace[i].tid == i / 8);
+    return 0;
+}
@@ -0,0 +1,115 @@
+#include <cassert>
+#include <memory>
+#include <sstream>
+#include <string>
+#include "../binary_commands.h"
+
+struct TrueSensor : public Sensor {
+    bool is_safe([[maybe_unused]] coordinate_t x,
+                 [[maybe_unused]] coordinate_t y) override {
+        return true;
+    }
+};
+
+bool malformed(std::vector<uint8_t> bytes) {
+    try {
+        BinaryCommands commands(std::move(bytes));
+    }
+    catch (MalformedCommands &e) {
+        return true;
+    }
+    return false;
+}
+
+std::string get_string_in_ostream(const auto &rover) {
+    std::stringstream s;
+    s << rover;
+    return s.str();
+}
+
+// The state a fresh rover ends in after the list, run as text and as
+// binary commands, which must agree.
+std::string run(Rover rover, const std::string &list,
+                const std::vector<std::string> &tokens) {
+    Rover binary = rover;
+    rover.land({0, 0}, Direction::NORTH);
+    rover.execute(list);
+    binary.land({0, 0}, Direction::NORTH);
+    binary.execute(BinaryCommands::encode(list, tokens));
+    assert(get_string_in_ostream(binary) == get_string_in_ostream(rover));
+    assert(binary.stop_reason() == rover.stop_reason());
+    return get_string_in_ostream(rover);
+}
+
+int main() {
+    // Each token is a prefix of the next one.
+    Rover nested = RoverBuilder()
+            .program_command('F', move_forward())
+            .program_command("FF", rotate_right())
+            .program_command("FFX", move_backward())
+            .add_sensor(std::make_unique<TrueSensor>())
+            .build();
+    std::vector<std::string> nested_tokens = {"FF", "FFX"};
+    assert(run(nested, "F", nested_tokens) == "(0, 1) NORTH");
+    // The longest token wins: "FF" turns, it is not two moves.
+    assert(run(nested, "FF", nested_tokens) == "(0, 0) EAST");
+    assert(run(nested, "FFX", nested_tokens) == "(0, -1) NORTH");
+    assert(run(nested, "FFF", nested_tokens) == "(1, 0) EAST");
+    assert(run(nested, "FFXF", nested_tokens) == "(0, 0) NORTH");
+    assert(run(nested, "FFXFF", nested_tokens) == "(0, -1) EAST");
+    // Matching is greedy and never goes back: "FFFX" is "FF", "F" and an
+    // unknown 'X', not "F" and "FFX".
+    assert(run(nested, "FFFX", nested_tokens) == "(1, 0) EAST stopped");
+    assert(run(nested, "FFXX", nested_tokens) == "(0, -1) NORTH stopped");
+    assert(run(nested, "FFY", nested_tokens) == "(0, 0) EAST stopped");
+    assert(run(nested, "X", nested_tokens) == "(0, 0) NORTH stopped");
+
+    // Tokens sharing prefixes, some of them no command of their own.
+    Rover shared = RoverBuilder()
+            .program_command('F', move_forward())
+            .program_command('R', rotate_right())
+            .program_command("F2", repeat(2, move_forward()))
+            .program_command("F10", repeat(10, move_forward()))
+            .program_command("RL", rotate_left())
+            .program_command("RLR", compose({rotate_left(), rotate_left()}))
+            .add_sensor(std::make_unique<TrueSensor>())
+            .build();
+    std::vector<std::string> shared_tokens = {"F2", "F10", "RL", "RLR"};
+    assert(run(shared, "F2", shared_tokens) == "(0, 2) NORTH");
+    assert(run(shared, "F10", shared_tokens) == "(0, 10) NORTH");
+    assert(run(shared, "F10F2F", shared_tokens) == "(0, 13) NORTH");
+    assert(run(shared, "RLF", shared_tokens) == "(-1, 0) WEST");
+    assert(run(shared, "RLRF", shared_tokens) == "(0, -1) SOUTH");
+    assert(run(shared, "RLRR", shared_tokens) == "(0, 0) WEST");
+    // A list ending inside a token runs what it can of it: "F1" is "F"
+    // followed by '1', which is no command.
+    assert(run(shared, "F2F1", shared_tokens) == "(0, 3) NORTH stopped");
+    assert(run(shared, "F1F2", shared_tokens) == "(0, 1) NORTH stopped");
+    assert(run(shared, "F100", shared_tokens) == "(0, 10) NORTH stopped");
+    assert(run(shared, "F3", shared_tokens) == "(0, 1) NORTH stopped");
+
+    Rover stopped = shared;
+    stopped.land({0, 0}, Direction::NORTH);
+    stopped.execute("F10F1");
+    assert(stopped.stop_reason() == StopReason::UNKNOWN_COMMAND);
+
+    // Decoded bytes: a dictionary of one token "F", whose records need
+    // no index bits, and a record.
+    auto with_record = [](std::vector<uint8_t> record) {
+        std::vector<uint8_t> bytes = {1, 1, 'F'};
+        bytes.insert(bytes.end(), record.begin(), record.end());
+        return bytes;
+    };
+    assert(!malformed(with_record({0x02})));
+    assert(BinaryCommands(with_record({0x02})).text() == "FFF");
+    // A count of 2^64 does not fit, UINT64_MAX does.
+    std::vector<uint8_t> max_record(9, 0xFF);
+    max_record.push_back(0x01);
+    assert(malformed(with_record(max_record)));
+    max_record[0] = 0xFE;
+    assert(!malformed(with_record(max_record)));
+    assert(malformed(with_record({0x80})));
+    assert(!malformed(with_record({0x01, 0x01})));
+    assert(malformed({2, 1, 'F'}));
+    return 0;
+}
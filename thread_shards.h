@@ -0,0 +1,87 @@
+#ifndef THREAD_SHARDS_H
+#define THREAD_SHARDS_H
+
+#include <array>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+
+// Objects of type T, one for each thread that asks for one, owned by the
+// ThreadShards and kept until it is destroyed. A thread finds its own
+// through a few thread_local entries naming their owner by a number that
+// is never reused, so an entry outliving its owner is never matched
+// again; on a miss it is looked up in the owner's table under a lock.
+template <class T>
+class ThreadShards {
+private:
+    constexpr static size_t CACHED = 4;
+
+    struct Cached {
+        uint64_t owner = 0;
+        T *shard = nullptr;
+    };
+
+    inline static std::atomic<uint64_t> next_owner = 1;
+    inline static std::atomic<uint64_t> next_thread = 0;
+
+    uint64_t owner = next_owner++;
+    mutable std::mutex mutex;
+    // By thread number, so in the order threads first asked.
+    std::map<uint64_t, std::unique_ptr<T>> shards;
+
+    // Numbers, unlike std::thread::id, are not reused by later threads;
+    // a shard may hold resources tied to the thread that made it.
+    static uint64_t thread() {
+        thread_local uint64_t number = next_thread++;
+        return number;
+    }
+
+public:
+    ThreadShards() = default;
+    ThreadShards(const ThreadShards &) = delete;
+    ThreadShards &operator=(const ThreadShards &) = delete;
+
+    // The calling thread's shard, made by make() on first use.
+    template <class Make>
+    T &local(Make make) {
+        thread_local std::array<Cached, CACHED> cache;
+        thread_local size_t replaced = 0;
+        for (const Cached &c : cache) {
+            if (c.owner == owner)
+                return *c.shard;
+        }
+        uint64_t me = thread();
+        T *found = nullptr;
+        {
+            std::lock_guard lock(mutex);
+            auto it = shards.find(me);
+            if (it != shards.end())
+                found = it->second.get();
+        }
+        if (found == nullptr) {
+            // Only this thread adds its own shard, so none came meanwhile.
+            std::unique_ptr<T> made = make();
+            found = made.get();
+            std::lock_guard lock(mutex);
+            shards.emplace(me, std::move(made));
+        }
+        cache[replaced++ % CACHED] = {owner, found};
+        return *found;
+    }
+
+    // Calls f on every shard, holding the lock.
+    template <class F>
+    void for_each(F f) const {
+        std::lock_guard lock(mutex);
+        for (const auto &[number, shard] : shards)
+            f(static_cast<const T &>(*shard));
+    }
+
+    size_t size() const {
+        std::lock_guard lock(mutex);
+        return shards.size();
+    }
+};
+
+#endif //THREAD_SHARDS_H
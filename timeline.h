@@ -0,0 +1,392 @@
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdio>
+#include <ios>
+#include <memory>
+#include <ostream>
+#include <string_view>
+#include <vector>
+#include "rover.h"
+#include "thread_shards.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Timestamps of spans. On x86 the time stamp counter is read directly, a
+// few nanoseconds cheaper than the system clock; Timeline converts it
+// to time when writing. Elsewhere the ticks are steady_clock's.
+struct TimelineClock {
+    static uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return static_cast<uint64_t>(
+                std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+    }
+};
+
+// Something that took time on a thread of a Timeline.
+struct TimelineSpan {
+    enum class Kind : uint8_t {
+        FLEET_BATCH,
+        EXECUTE,
+        COMMAND,
+        COMPOSE,
+        SENSOR
+    };
+
+    // Longer command tokens are cut to that many characters.
+    constexpr static size_t TOKEN = 15;
+
+    Kind kind;
+    uint8_t token_length = 0;
+    std::array<char, TOKEN> token = {};
+    uint64_t start = 0, end = 0;
+    // The rover's number for EXECUTE, COMMAND, COMPOSE and SENSOR.
+    uint64_t rover = 0;
+    // Rovers of a FLEET_BATCH, the body of a COMPOSE and the index of a
+    // SENSOR.
+    uint64_t arg = 0;
+    // Times a COMPOSE body is run in a row.
+    uint64_t times = 0;
+};
+
+// Spans of rovers and fleets on any number of threads, written as Chrome
+// trace events (JSON, opened by chrome://tracing and Perfetto). Each
+// thread records into its own ring of the latest capacity spans, found
+// through a thread_local cache, without locks or allocation. The rings
+// are read when writing, which must not happen while traced threads
+// still record.
+class Timeline {
+public:
+    class Ring {
+    private:
+        std::vector<TimelineSpan> spans;
+        uint64_t mask;
+        uint64_t recorded = 0;
+
+        friend class Timeline;
+
+    public:
+        // The capacity is rounded up to a power of two.
+        explicit Ring(size_t capacity) :
+            spans(std::bit_ceil(std::max<size_t>(capacity, 1))),
+            mask(spans.size() - 1) {}
+
+        void record(const TimelineSpan &span) {
+            spans[recorded++ & mask] = span;
+        }
+
+        // The slot of the next span, to be filled in place.
+        TimelineSpan &next() {
+            return spans[recorded++ & mask];
+        }
+    };
+
+    // A fleet batch, timed for as long as it lives:
+    //
+    //     {
+    //         Timeline::Batch batch(timeline, fleet.size());
+    //         fleet.execute(commands);
+    //     }
+    class Batch {
+    private:
+        Ring &ring;
+        TimelineSpan span;
+    public:
+        Batch(Timeline &timeline, size_t rovers) : ring(timeline.ring()) {
+            span.kind = TimelineSpan::Kind::FLEET_BATCH;
+            span.arg = rovers;
+            span.start = TimelineClock::now();
+        }
+
+        ~Batch() {
+            span.end = TimelineClock::now();
+            ring.record(span);
+        }
+
+        Batch(const Batch &) = delete;
+        Batch &operator=(const Batch &) = delete;
+    };
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    size_t capacity;
+    uint64_t first_tick;
+    clock::time_point first_time;
+
+    ThreadShards<Ring> rings;
+
+    static void write_token(std::ostream &os, const TimelineSpan &span) {
+        for (size_t i = 0; i < span.token_length; ++i) {
+            auto c = static_cast<unsigned char>(span.token[i]);
+            if (c == '"' || c == '\\') {
+                os << '\\' << span.token[i];
+            }
+            else if (c < 0x20 || c >= 0x7f) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                os << escaped;
+            }
+            else {
+                os << span.token[i];
+            }
+        }
+    }
+
+    // Microseconds per tick, from the ticks and time since construction.
+    // The estimate is off by the time between reading the two clocks,
+    // spread over the whole baseline, so spans recorded since are off by
+    // at most that much however soon the trace is written.
+    double tick_us() const {
+        uint64_t ticks = TimelineClock::now() - first_tick;
+        std::chrono::duration<double, std::micro> elapsed =
+                clock::now() - first_time;
+        return ticks == 0 ? 0 : elapsed.count() / static_cast<double>(ticks);
+    }
+
+public:
+    explicit Timeline(size_t capacity = 1 << 16) :
+        capacity(capacity), first_tick(TimelineClock::now()),
+        first_time(clock::now()) {}
+
+    Timeline(const Timeline &) = delete;
+    Timeline &operator=(const Timeline &) = delete;
+
+    // The calling thread's ring, made on first use.
+    Ring &ring() {
+        return rings.local([&] { return std::make_unique<Ring>(capacity); });
+    }
+
+    // Spans kept, counting those overwritten since.
+    uint64_t size() const {
+        uint64_t n = 0;
+        rings.for_each([&](const Ring &ring) { n += ring.recorded; });
+        return n;
+    }
+
+    // Writes the spans kept as a Chrome trace, a thread of the trace for
+    // each thread recorded on.
+    void write_json(std::ostream &os) const {
+        const char *names[] = {"fleet batch", "execute", "command",
+                               "compose", "sensor"};
+        double us = tick_us();
+        auto time = [&](uint64_t tick) {
+            return static_cast<double>(tick - first_tick) * us;
+        };
+        std::ios_base::fmtflags flags = os.flags();
+        std::streamsize precision = os.precision(3);
+        os.setf(std::ios_base::fixed, std::ios_base::floatfield);
+        os << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        bool first = true;
+        size_t t = 0;
+        rings.for_each([&](const Ring &ring) {
+            size_t kept = std::min<uint64_t>(ring.recorded, ring.spans.size());
+            for (uint64_t i = ring.recorded - kept; i < ring.recorded; ++i) {
+                const TimelineSpan &s = ring.spans[i & ring.mask];
+                os << (first ? "\n" : ",\n") << "{\"name\":\"";
+                first = false;
+                if (s.kind == TimelineSpan::Kind::COMMAND)
+                    write_token(os, s);
+                else
+                    os << names[static_cast<int>(s.kind)];
+                os << "\",\"cat\":\"" << names[static_cast<int>(s.kind)]
+                   << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << t
+                   << ",\"ts\":" << time(s.start)
+                   << ",\"dur\":" << std::max(0.0, time(s.end) - time(s.start))
+                   << ",\"args\":{";
+                switch (s.kind) {
+                    case TimelineSpan::Kind::FLEET_BATCH:
+                        os << "\"rovers\":" << s.arg;
+                        break;
+                    case TimelineSpan::Kind::COMPOSE:
+                        os << "\"rover\":" << s.rover << ",\"body\":" << s.arg
+                           << ",\"times\":" << s.times;
+                        break;
+                    case TimelineSpan::Kind::SENSOR:
+                        os << "\"rover\":" << s.rover << ",\"sensor\":"
+                           << s.arg;
+                        break;
+                    default:
+                        os << "\"rover\":" << s.rover;
+                        break;
+                }
+                os << "}}";
+            }
+            ++t;
+        });
+        os << "\n]}\n";
+        os.flags(flags);
+        os.precision(precision);
+    }
+};
+
+// Observer recording a rover's execute calls, the commands of text lists,
+// the composed bodies stepped through and the sensors asked as spans of a
+// Timeline. Rovers start without a timeline and record nothing until
+// attached to one, under a number telling them apart in the trace:
+//
+//     struct Traced : DefaultRoverPolicy {
+//         using observer_type = TimelineObserver;
+//     };
+//     Timeline timeline;
+//     rover.observer().attach(timeline, 7);
+//     ...
+//     timeline.write_json(file);
+//
+// A span costs two TimelineClock::now() reads and a store into the ring.
+// bench/suite.cc reports the time added per span as timeline_per_span:
+// about 30 ns on a virtual machine where reading the time stamp counter
+// takes about 15 ns, most spans being sensor queries.
+class TimelineObserver : public NullObserver {
+public:
+    constexpr static bool enabled = true;
+    // Composed bodies nested deeper are not recorded.
+    constexpr static size_t COMPOSE_DEPTH = 16;
+
+private:
+    Timeline *timeline = nullptr;
+    Timeline::Ring *ring = nullptr;
+    uint64_t rover = 0;
+    TimelineSpan execute, command;
+    // Start of the sensor query being timed, and its sensor.
+    uint64_t probe_start = 0;
+    size_t probe_sensor = 0;
+    bool commanding = false;
+    // Composed bodies being stepped through, innermost last; deeper ones
+    // are only counted, so that recording never allocates.
+    std::array<TimelineSpan, COMPOSE_DEPTH> composes;
+    size_t depth = 0;
+
+    TimelineSpan span(TimelineSpan::Kind kind) const {
+        TimelineSpan s;
+        s.kind = kind;
+        s.rover = rover;
+        return s;
+    }
+
+    void end(TimelineSpan &s, uint64_t now) {
+        s.end = now;
+        ring->record(s);
+    }
+
+    void end_compose(uint64_t now) {
+        --depth;
+        if (depth < composes.size())
+            end(composes[depth], now);
+    }
+
+    // Sensor spans, by far the most common, are written in place.
+    void end_probe() {
+        uint64_t now = TimelineClock::now();
+        TimelineSpan &s = ring->next();
+        s.kind = TimelineSpan::Kind::SENSOR;
+        s.token_length = 0;
+        s.start = probe_start;
+        s.end = now;
+        s.rover = rover;
+        s.arg = probe_sensor;
+        s.times = 0;
+    }
+
+    void end_command(uint64_t now) {
+        while (depth > 0)
+            end_compose(now);
+        if (commanding)
+            end(command, now);
+        commanding = false;
+    }
+
+public:
+    void attach(Timeline &t, uint64_t number = 0) {
+        timeline = &t;
+        rover = number;
+    }
+
+    void on_execute_begin([[maybe_unused]] const Position &p) {
+        // The rover may run on another thread than the last time.
+        ring = timeline == nullptr ? nullptr : &timeline->ring();
+        if (ring == nullptr)
+            return;
+        commanding = false;
+        depth = 0;
+        execute = span(TimelineSpan::Kind::EXECUTE);
+        execute.start = TimelineClock::now();
+    }
+
+    void on_dispatch(std::string_view name) {
+        if (ring == nullptr)
+            return;
+        uint64_t now = TimelineClock::now();
+        end_command(now);
+        command = span(TimelineSpan::Kind::COMMAND);
+        command.token_length = static_cast<uint8_t>(
+                std::min(name.size(), TimelineSpan::TOKEN));
+        std::copy_n(name.begin(), command.token_length, command.token.begin());
+        command.start = now;
+        commanding = true;
+    }
+
+    void on_compose_begin(uint32_t body, uint64_t times) {
+        if (ring == nullptr)
+            return;
+        if (depth < composes.size()) {
+            TimelineSpan &s = composes[depth];
+            s = span(TimelineSpan::Kind::COMPOSE);
+            s.arg = body;
+            s.times = times;
+            s.start = TimelineClock::now();
+        }
+        ++depth;
+    }
+
+    void on_compose_end() {
+        if (ring != nullptr && depth > 0)
+            end_compose(TimelineClock::now());
+    }
+
+    void on_probe_begin(size_t sensor) {
+        if (ring == nullptr)
+            return;
+        probe_sensor = sensor;
+        probe_start = TimelineClock::now();
+    }
+
+    void on_probe([[maybe_unused]] size_t sensor,
+                  [[maybe_unused]] coordinate_t x,
+                  [[maybe_unused]] coordinate_t y,
+                  [[maybe_unused]] bool safe) {
+        if (ring != nullptr)
+            end_probe();
+    }
+
+    void on_run([[maybe_unused]] size_t sensor,
+                [[maybe_unused]] coordinate_t x,
+                [[maybe_unused]] coordinate_t y,
+                [[maybe_unused]] Direction d,
+                [[maybe_unused]] coordinate_t limit,
+                [[maybe_unused]] coordinate_t free) {
+        if (ring != nullptr)
+            end_probe();
+    }
+
+    void on_execute_end([[maybe_unused]] const Position &p,
+                        [[maybe_unused]] StopReason reason) {
+        if (ring == nullptr)
+            return;
+        uint64_t now = TimelineClock::now();
+        // Bodies left by a custom action throwing DangerousField end here.
+        end_command(now);
+        end(execute, now);
+    }
+};
+
+#endif //TIMELINE_H
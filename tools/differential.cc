@@ -0,0 +1,923 @@
+// Differential tester: runs random command tables and command lists on
+// random worlds through every engine that runs commands and compares
+// each of them with a reference rover. The reference calls the actions'
+// own execute methods one command at a time, the way rovers ran before
+// commands were lowered to a Program, so it is slow but easy to trust.
+//
+// Every case is made from its seed alone. A mismatch is shrunk to a small
+// case, printed with its seed, and the tester exits with status 1.
+//
+//     differential [--cases N] [--seconds S] [--seed S] [--threads N]
+//                  [--per-command]
+//
+// --cases 0 runs until --seconds have passed. --per-command compares the
+// states after every command instead of after every list.
+//
+// g++ -Wall -Wextra -O2 -std=c++20 -pthread tools/differential.cc -o differential
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <typeinfo>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "../binary_commands.h"
+#include "../bloom_sensor.h"
+#include "../fleet.h"
+#include "../generator.h"
+#include "../interval_sensor.h"
+#include "../noise_sensor.h"
+#include "../observers.h"
+#include "../rtree_sensor.h"
+
+// A custom action, so that the interpreter's escape to virtual actions
+// is covered as well. It may stop after the first of its two steps.
+struct Hop : public Action {
+    void execute(Position &p, const sensors_t &sensors) override {
+        MoveForward step;
+        step.execute(p, sensors);
+        step.execute(p, sensors);
+    }
+};
+
+// Sensor a world is made of. The reference asks each field of every
+// world but GENERATED to a plain sensor scanning all the shapes, so that
+// the segment queries of the engines' sensors are checked too.
+enum class WorldKind {
+    GENERATED,
+    RTREE,
+    INTERVAL,
+    NOISE,
+    BLOOM
+};
+
+constexpr uint32_t WORLD_KINDS = 5;
+
+struct Case {
+    uint64_t seed = 0;
+    WorldKind kind = WorldKind::GENERATED;
+    HazardOptions world;
+    std::vector<HazardRect> rectangles;
+    std::vector<HazardPolygon> polygons;
+    std::vector<HazardSpan> spans;
+    // Noise is seeded by the world's seed.
+    uint32_t noise_scale_log2 = 0;
+    uint32_t noise_threshold = 0;
+    // Dangerous cells, and safe ones put in the Bloom filter all the same.
+    std::vector<std::pair<coordinate_t, coordinate_t>> cells;
+    std::vector<std::pair<coordinate_t, coordinate_t>> decoys;
+    double bits_per_hazard = 16;
+    commands_t commands;
+    command_tokens_t tokens;
+    std::vector<Position> landings;
+    std::vector<std::string> lists;
+};
+
+// What a rover shows after a list, and why it stopped.
+struct State {
+    std::string shown;
+    StopReason reason;
+};
+
+// States of every rover after every list, rover by rover.
+using Trace = std::vector<State>;
+
+template <class R>
+State state_of(const R &rover) {
+    std::stringstream s;
+    s << rover;
+    return {s.str(), rover.stop_reason()};
+}
+
+// Range an engine keeps its rovers in. The reference gets a sensor
+// refusing the fields outside it, and only rovers landed inside are run.
+enum class Bounds {
+    NONE,
+    INT32_STOP,
+    INT16
+};
+
+// No range at all.
+struct Unbounded : public Sensor {
+    static bool contains(coordinate_t, coordinate_t) {
+        return true;
+    }
+
+    bool is_safe(coordinate_t, coordinate_t) override {
+        return true;
+    }
+};
+
+// Sensor refusing the fields out of the range, remembering whether it
+// refused the last one it was asked about.
+template <class Range>
+struct RecordingRange : public Range {
+    bool refused = false;
+
+    bool is_safe(coordinate_t x, coordinate_t y) override {
+        refused = !Range::is_safe(x, y);
+        return !refused;
+    }
+};
+
+// Rectangles and polygons, checked one by one. Polygons are small, so
+// their cross products fit in 64 bits. Long moves through empty land
+// would be slow, so each shape is listed under the 256 x 256 blocks its
+// bounding box meets and only the shapes of a field's block are checked.
+struct Shapes : public Sensor {
+    std::vector<HazardRect> rectangles;
+    std::vector<HazardPolygon> polygons;
+    // Shapes by block: rectangles first, then polygons.
+    std::unordered_map<uint64_t, std::vector<size_t>> blocks;
+
+    Shapes(std::vector<HazardRect> rectangles_,
+           std::vector<HazardPolygon> polygons_) :
+        rectangles(std::move(rectangles_)), polygons(std::move(polygons_)) {
+        auto list = [this](const HazardRect &r, size_t shape) {
+            for (int64_t bx = block_of(std::min(r.x0, r.x1));
+                    bx <= block_of(std::max(r.x0, r.x1)); ++bx) {
+                for (int64_t by = block_of(std::min(r.y0, r.y1));
+                        by <= block_of(std::max(r.y0, r.y1)); ++by)
+                    blocks[key(bx, by)].push_back(shape);
+            }
+        };
+        for (size_t i = 0; i < rectangles.size(); ++i)
+            list(rectangles[i], i);
+        for (size_t i = 0; i < polygons.size(); ++i) {
+            HazardRect box = {INT32_MAX, INT32_MAX, INT32_MIN, INT32_MIN};
+            for (auto [x, y] : polygons[i].vertices) {
+                box.x0 = std::min(box.x0, x);
+                box.y0 = std::min(box.y0, y);
+                box.x1 = std::max(box.x1, x);
+                box.y1 = std::max(box.y1, y);
+            }
+            list(box, rectangles.size() + i);
+        }
+    }
+
+    static int64_t block_of(coordinate_t c) {
+        return c >> 8;
+    }
+
+    static uint64_t key(int64_t bx, int64_t by) {
+        return static_cast<uint64_t>(bx) << 32 ^
+               static_cast<uint32_t>(by);
+    }
+
+    static bool in_rect(const HazardRect &r, coordinate_t x, coordinate_t y) {
+        return std::min(r.x0, r.x1) <= x && x <= std::max(r.x0, r.x1) &&
+               std::min(r.y0, r.y1) <= y && y <= std::max(r.y0, r.y1);
+    }
+
+    static bool in_polygon(const HazardPolygon &polygon, int64_t px,
+                           int64_t py) {
+        const auto &v = polygon.vertices;
+        bool in = false;
+        for (size_t i = 0, j = v.size() - 1; i < v.size(); j = i++) {
+            int64_t xi = v[i].first, yi = v[i].second;
+            int64_t xj = v[j].first, yj = v[j].second;
+            int64_t cross = (xj - xi) * (py - yi) - (yj - yi) * (px - xi);
+            if (cross == 0 && std::min(xi, xj) <= px &&
+                    px <= std::max(xi, xj) && std::min(yi, yj) <= py &&
+                    py <= std::max(yi, yj))
+                return true;
+            if ((yi > py) != (yj > py) && (cross > 0) == (yj > yi))
+                in = !in;
+        }
+        return in;
+    }
+
+    bool is_safe(coordinate_t x, coordinate_t y) override {
+        auto block = blocks.find(key(block_of(x), block_of(y)));
+        if (block == blocks.end())
+            return true;
+        for (size_t shape : block->second) {
+            bool in = shape < rectangles.size() ?
+                      in_rect(rectangles[shape], x, y) :
+                      in_polygon(polygons[shape - rectangles.size()], x, y);
+            if (in)
+                return false;
+        }
+        return true;
+    }
+};
+
+// Spans of each row, checked one by one.
+struct Spans : public Sensor {
+    std::unordered_map<coordinate_t, std::vector<HazardSpan>> rows;
+
+    Spans(const std::vector<HazardSpan> &spans) {
+        for (const auto &span : spans)
+            rows[span.y].push_back(span);
+    }
+
+    bool is_safe(coordinate_t x, coordinate_t y) override {
+        auto row = rows.find(y);
+        if (row == rows.end())
+            return true;
+        for (const auto &span : row->second) {
+            if (std::min(span.x0, span.x1) <= x &&
+                    x <= std::max(span.x0, span.x1))
+                return false;
+        }
+        return true;
+    }
+};
+
+// Dangerous cells, looked up one by one.
+struct Cells : public Sensor {
+    std::unordered_set<uint64_t> dangerous;
+
+    Cells(const std::vector<std::pair<coordinate_t, coordinate_t>> &cells) {
+        for (auto [x, y] : cells)
+            dangerous.insert(key(x, y));
+    }
+
+    static uint64_t key(coordinate_t x, coordinate_t y) {
+        return uint64_t{static_cast<uint32_t>(x)} << 32 |
+               static_cast<uint32_t>(y);
+    }
+
+    bool is_safe(coordinate_t x, coordinate_t y) override {
+        return !dangerous.contains(key(x, y));
+    }
+};
+
+// Filter of the dangerous cells and the decoys over the exact cells, so
+// that the decoys fall through to the exact sensor.
+BloomSensor bloom(const Case &c) {
+    auto listed = c.cells;
+    listed.insert(listed.end(), c.decoys.begin(), c.decoys.end());
+    return BloomSensor(std::make_shared<Cells>(c.cells), listed,
+                       c.bits_per_hazard);
+}
+
+// Sensor asked field by field, never for a row or a segment.
+template <class S>
+struct FieldByField : public Sensor {
+    S sensor;
+
+    FieldByField(S sensor_) : sensor(std::move(sensor_)) {}
+
+    bool is_safe(coordinate_t x, coordinate_t y) override {
+        return sensor.is_safe(x, y);
+    }
+};
+
+NoiseSensor noise(const Case &c) {
+    return NoiseSensor(static_cast<uint32_t>(c.world.seed),
+                       c.noise_scale_log2, c.noise_threshold);
+}
+
+// Calls f with the sensor of the case's world, held by value.
+template <class F>
+auto with_hazards(const Case &c, F f) {
+    switch (c.kind) {
+        case WorldKind::RTREE:
+            return f(RTreeSensor(c.rectangles, c.polygons));
+        case WorldKind::INTERVAL:
+            return f(IntervalSensor(c.spans));
+        case WorldKind::NOISE:
+            return f(noise(c));
+        case WorldKind::BLOOM:
+            return f(bloom(c));
+        default:
+            return f(GeneratedHazards(c.world));
+    }
+}
+
+sensors_t hazards(const Case &c) {
+    return with_hazards(c, []<class S>(S sensor) {
+        return sensors_t{std::make_shared<S>(std::move(sensor))};
+    });
+}
+
+std::shared_ptr<Sensor> reference_hazards(const Case &c) {
+    switch (c.kind) {
+        case WorldKind::RTREE:
+            return std::make_shared<Shapes>(c.rectangles, c.polygons);
+        case WorldKind::INTERVAL:
+            return std::make_shared<Spans>(c.spans);
+        case WorldKind::NOISE:
+            return std::make_shared<FieldByField<NoiseSensor>>(noise(c));
+        case WorldKind::BLOOM:
+            return std::make_shared<Cells>(c.cells);
+        default:
+            return std::make_shared<GeneratedHazards>(c.world);
+    }
+}
+
+// Length of the command the list has at position i, 0 when it is not
+// programmed: the longest of the programmed names it starts with.
+size_t command_length(const Case &c, std::string_view list, size_t i) {
+    size_t length = c.commands.contains(list[i]);
+    for (const auto &[token, action] : c.tokens) {
+        if (token.size() > length && list.substr(i).starts_with(token))
+            length = token.size();
+    }
+    return length;
+}
+
+template <class Range>
+Trace reference_with(const Case &c) {
+    auto range = std::make_shared<RecordingRange<Range>>();
+    sensors_t sensors = {range, reference_hazards(c)};
+    Trace trace;
+    for (Position p : c.landings) {
+        for (const auto &list : c.lists) {
+            StopReason reason = StopReason::NONE;
+            for (size_t i = 0; i < list.size();) {
+                size_t length = command_length(c, list, i);
+                if (length == 0) {
+                    reason = StopReason::UNKNOWN_COMMAND;
+                    break;
+                }
+                Action &action = length == 1
+                        ? *c.commands.at(list[i])
+                        : *c.tokens.find(list.substr(i, length))->second;
+                i += length;
+                try {
+                    action.execute(p, sensors);
+                }
+                catch (DangerousField &e) {
+                    reason = range->refused ? StopReason::OUT_OF_RANGE
+                                            : StopReason::DANGEROUS_FIELD;
+                    break;
+                }
+            }
+            std::stringstream s;
+            s << p;
+            if (reason != StopReason::NONE)
+                s << " stopped";
+            trace.push_back({s.str(), reason});
+        }
+    }
+    return trace;
+}
+
+template <class Range>
+Case landed_in(const Case &c) {
+    Case result = c;
+    std::erase_if(result.landings, [](const Position &p) {
+        Coordinates at = p.get_coordinates();
+        return !Range::contains(at.get_x(), at.get_y());
+    });
+    return result;
+}
+
+template <class F>
+auto with_range(Bounds bounds, F f) {
+    switch (bounds) {
+        case Bounds::INT32_STOP:
+            return f.template operator()<CoordinateRange<coordinate_t, 1>>();
+        case Bounds::INT16:
+            return f.template operator()<CoordinateRange<int16_t>>();
+        default:
+            return f.template operator()<Unbounded>();
+    }
+}
+
+// Lists as they are run: whole, or one command each. Characters not
+// starting a command make lists of their own.
+Case split_commands(const Case &c) {
+    Case result = c;
+    result.lists.clear();
+    for (const auto &list : c.lists) {
+        for (size_t i = 0; i < list.size();) {
+            size_t length = std::max<size_t>(command_length(c, list, i), 1);
+            result.lists.push_back(list.substr(i, length));
+            i += length;
+        }
+    }
+    return result;
+}
+
+template <class R, class Make, class Run>
+Trace run_rovers(const Case &c, Make make, Run run) {
+    Trace trace;
+    for (const Position &landing : c.landings) {
+        R rover = make();
+        rover.land(landing.get_coordinates(), landing.get_direction());
+        for (const auto &list : c.lists) {
+            run(rover, list);
+            trace.push_back(state_of(rover));
+        }
+    }
+    return trace;
+}
+
+template <class R>
+Trace run_text(const Case &c) {
+    return run_rovers<R>(c, [&] { return R(c.commands, c.tokens, hazards(c)); },
+                         [](R &rover, const std::string &list) {
+        rover.execute(list);
+    });
+}
+
+// A fleet does not tell why its rovers stopped, only whether they did.
+template <class T>
+Trace run_fleet(const Case &c) {
+    BasicFleet<T> fleet(c.commands, hazards(c), c.tokens);
+    for (const Position &landing : c.landings)
+        fleet.land(landing.get_coordinates(), landing.get_direction());
+    size_t lists = c.lists.size();
+    Trace trace(c.landings.size() * lists);
+    for (size_t l = 0; l < lists; ++l) {
+        fleet.execute(c.lists[l]);
+        for (size_t i = 0; i < fleet.size(); ++i) {
+            std::stringstream s;
+            s << fleet.position(i);
+            StopReason reason = StopReason::NONE;
+            if (fleet.is_stopped(i)) {
+                s << " stopped";
+                reason = StopReason::DANGEROUS_FIELD;
+            }
+            trace[i * lists + l] = {s.str(), reason};
+        }
+    }
+    return trace;
+}
+
+struct Stop : DefaultRoverPolicy {
+    constexpr static Overflow overflow = Overflow::STOP;
+};
+
+struct Small : DefaultRoverPolicy {
+    using coordinate_type = int16_t;
+};
+
+// Observers asking the sensors one by one must not change a thing.
+struct Counted : DefaultRoverPolicy {
+    using observer_type = CountingObserver;
+};
+
+struct Engine {
+    const char *name;
+    Bounds bounds;
+    // Whether the engine tells why its rovers stopped.
+    bool reasons;
+    Trace (*run)(const Case &);
+};
+
+const Engine ENGINES[] = {
+    {"program", Bounds::NONE, true, run_text<Rover>},
+    {"binary", Bounds::NONE, true, [](const Case &c) {
+        std::vector<std::string> tokens;
+        for (const auto &[token, action] : c.tokens)
+            tokens.push_back(token);
+        return run_rovers<Rover>(c, [&] {
+            return Rover(c.commands, c.tokens, hazards(c));
+        }, [&](Rover &rover, const std::string &list) {
+            rover.execute(BinaryCommands::encode(list, tokens));
+        });
+    }},
+    {"static_sensors", Bounds::NONE, true, [](const Case &c) {
+        return with_hazards(c, [&]<class S>(const S &sensor) {
+            using R = BasicRover<S>;
+            return run_rovers<R>(c, [&] {
+                return R(c.commands, c.tokens, sensor);
+            }, [](R &rover, const std::string &list) {
+                rover.execute(list);
+            });
+        });
+    }},
+    {"fleet", Bounds::NONE, false, run_fleet<coordinate_t>},
+    {"observed", Bounds::NONE, true, run_text<PolicyRover<Counted, sensors_t>>},
+    {"cached", Bounds::NONE, true, [](const Case &c) {
+        return run_rovers<Rover>(c, [&] {
+            sensors_t cache = {std::make_shared<SafeRegionCache>(hazards(c))};
+            return Rover(c.commands, c.tokens, std::move(cache));
+        }, [](Rover &rover, const std::string &list) {
+            rover.execute(list);
+        });
+    }},
+    {"overflow_stop", Bounds::INT32_STOP, true,
+     run_text<PolicyRover<Stop, sensors_t>>},
+    {"int16", Bounds::INT16, true, run_text<PolicyRover<Small, sensors_t>>},
+    {"fleet16", Bounds::INT16, false, run_fleet<int16_t>},
+};
+
+// Index of the first state the engine gets wrong, or -1.
+ptrdiff_t first_difference(const Engine &engine, const Case &c,
+                           const Trace &expected) {
+    Trace actual = engine.run(c);
+    for (size_t i = 0; i < expected.size(); ++i) {
+        bool same = actual[i].shown == expected[i].shown &&
+                    (!engine.reasons || actual[i].reason == expected[i].reason);
+        if (!same)
+            return static_cast<ptrdiff_t>(i);
+    }
+    return -1;
+}
+
+// References already worked out for a case are kept in known, if given:
+// engines with the same bounds share one.
+bool fails(const Engine &engine, const Case &c,
+           std::map<Bounds, Trace> *known = nullptr) {
+    return with_range(engine.bounds, [&]<class Range>() {
+        Case landed = landed_in<Range>(c);
+        if (known == nullptr)
+            return first_difference(engine, landed,
+                                    reference_with<Range>(landed)) >= 0;
+        auto it = known->find(engine.bounds);
+        if (it == known->end())
+            it = known->emplace(engine.bounds,
+                                reference_with<Range>(landed)).first;
+        return first_difference(engine, landed, it->second) >= 0;
+    });
+}
+
+// Random action at most depth levels deep, expanding to about budget
+// primitive steps at most.
+std::shared_ptr<Action> random_action(SplitMix64 &random, int depth,
+                                      uint64_t budget) {
+    uint32_t kind = random.below(depth > 0 ? 8 : 5);
+    switch (kind) {
+        case 0: return move_forward();
+        case 1: return move_backward();
+        case 2: return rotate_left();
+        case 3: return rotate_right();
+        case 4:
+            return random.below(2) ? std::shared_ptr<Action>(
+                                             std::make_shared<Hop>())
+                                   : move_until_unsafe(
+                                             static_cast<coordinate_t>(
+                                                     random.below(64)));
+        case 5:
+        case 6: {
+            std::vector<std::shared_ptr<Action>> parts(1 + random.below(4));
+            for (auto &part : parts)
+                part = random_action(random, depth - 1, budget / parts.size());
+            return compose(parts);
+        }
+        default: {
+            uint64_t times = random.below(4) == 0
+                             ? random.below(static_cast<uint32_t>(
+                                       std::min<uint64_t>(budget, 5000)) + 1)
+                             : random.below(12);
+            return repeat(times, random_action(random, depth - 1,
+                                               budget / std::max<uint64_t>(
+                                                       times, 1)));
+        }
+    }
+}
+
+// Fields near the origin, near the edges of int16_t or near the edges of
+// coordinate_t.
+coordinate_t random_coordinate(SplitMix64 &random) {
+    auto near = [&](int64_t c) {
+        return static_cast<coordinate_t>(c - 40 + random.below(81));
+    };
+    switch (random.below(5)) {
+        case 0: return near(INT16_MAX);
+        case 1: return near(INT16_MIN);
+        case 2: return static_cast<coordinate_t>(INT32_MAX - random.below(40));
+        case 3: return static_cast<coordinate_t>(INT32_MIN + random.below(40));
+        default: return near(0);
+    }
+}
+
+Case make_case(uint64_t seed) {
+    SplitMix64 random(seed);
+    Case c;
+    c.seed = seed;
+    c.world = {
+        .seed = random.next(),
+        .density = random.below(300) / 1000.0,
+        .clustering = random.below(101) / 100.0,
+        .cluster_log2 = random.below(5),
+        .corridor_spacing = random.below(3) == 0 ? 2 + random.below(10) : 0,
+    };
+    c.commands = {
+        {'F', move_forward()},
+        {'B', move_backward()},
+        {'L', rotate_left()},
+        {'R', rotate_right()},
+    };
+    std::string names = "FBLR";
+    for (char name = 'a'; name < 'a' + static_cast<char>(random.below(9));
+         ++name) {
+        c.commands[name] = random_action(random, 4, 20000);
+        names += name;
+    }
+    // 'X' is never programmed.
+    names += 'X';
+    // Tokens longer than a character share prefixes with each other and
+    // with single commands; lists hold them whole or cut short.
+    std::vector<std::string> tokens;
+    if (random.below(3) == 0) {
+        std::string alphabet = names + "012";
+        for (uint32_t i = 1 + random.below(4); i > 0; --i) {
+            std::string token(1, names[random.below(
+                    static_cast<uint32_t>(names.size()))]);
+            for (uint32_t k = 1 + random.below(2); k > 0; --k)
+                token += alphabet[random.below(
+                        static_cast<uint32_t>(alphabet.size()))];
+            c.tokens[token] = random_action(random, 4, 20000);
+            tokens.push_back(token);
+        }
+    }
+    for (uint32_t i = 1 + random.below(4); i > 0; --i) {
+        c.landings.push_back({{random_coordinate(random),
+                               random_coordinate(random)},
+                              static_cast<Direction>(random.below(4))});
+    }
+    for (uint32_t i = 1 + random.below(4); i > 0; --i) {
+        std::string list;
+        for (uint32_t j = random.below(40); j > 0; --j) {
+            if (!tokens.empty() && random.below(4) == 0) {
+                const std::string &token = tokens[random.below(
+                        static_cast<uint32_t>(tokens.size()))];
+                list += token.substr(0, token.size() - (random.below(4) == 0));
+                continue;
+            }
+            char command = names[random.below(
+                    static_cast<uint32_t>(names.size()) - (random.below(8) != 0))];
+            list.append(1 + (random.below(4) == 0) * random.below(30),
+                        command);
+        }
+        c.lists.push_back(list);
+    }
+
+    // Shapes are placed around the landings, where the rovers go.
+    auto near = [&](coordinate_t c, uint32_t radius) {
+        int64_t moved = int64_t{c} - radius + random.below(2 * radius + 1);
+        return static_cast<coordinate_t>(
+                std::clamp<int64_t>(moved, INT32_MIN, INT32_MAX));
+    };
+    c.kind = static_cast<WorldKind>(random.below(WORLD_KINDS));
+    c.noise_scale_log2 = random.below(9);
+    c.noise_threshold = random.below(120);
+    // Small filters, so that many safe cells fall through.
+    c.bits_per_hazard = 1 + random.below(8);
+    for (const Position &landing : c.landings) {
+        coordinate_t lx = landing.get_coordinates().get_x();
+        coordinate_t ly = landing.get_coordinates().get_y();
+        switch (c.kind) {
+            case WorldKind::RTREE:
+                for (uint32_t i = random.below(40); i > 0; --i) {
+                    coordinate_t x = near(lx, 60), y = near(ly, 60);
+                    c.rectangles.push_back({x, y, near(x, 4), near(y, 4)});
+                }
+                for (uint32_t i = random.below(10); i > 0; --i) {
+                    coordinate_t x = near(lx, 60), y = near(ly, 60);
+                    HazardPolygon polygon;
+                    for (uint32_t v = 3 + random.below(4); v > 0; --v)
+                        polygon.vertices.emplace_back(near(x, 10), near(y, 10));
+                    c.polygons.push_back(polygon);
+                }
+                break;
+            case WorldKind::INTERVAL:
+                // Few rows, so that spans overlap, touch and get merged.
+                for (uint32_t i = random.below(60); i > 0; --i) {
+                    coordinate_t x = near(lx, 60);
+                    c.spans.push_back({near(ly, 20), x, near(x, 12)});
+                }
+                break;
+            case WorldKind::BLOOM:
+                for (uint32_t i = random.below(300); i > 0; --i)
+                    c.cells.emplace_back(near(lx, 40), near(ly, 40));
+                for (uint32_t i = random.below(300); i > 0; --i) {
+                    std::pair<coordinate_t, coordinate_t> decoy = {
+                            near(lx, 40), near(ly, 40)};
+                    if (std::find(c.cells.begin(), c.cells.end(), decoy) ==
+                            c.cells.end())
+                        c.decoys.push_back(decoy);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    return c;
+}
+
+// Smallest case found, by dropping landings and lists and then chunks of
+// the lists, while the engine still fails.
+Case shrink(const Engine &engine, Case c) {
+    bool progress = true;
+    auto attempt = [&](const Case &candidate) {
+        if (!fails(engine, candidate))
+            return false;
+        c = candidate;
+        progress = true;
+        return true;
+    };
+    while (progress) {
+        progress = false;
+        for (size_t i = 0; i < c.landings.size() && c.landings.size() > 1;) {
+            Case candidate = c;
+            candidate.landings.erase(candidate.landings.begin() + i);
+            if (!attempt(candidate))
+                ++i;
+        }
+        for (size_t i = 0; i < c.lists.size() && c.lists.size() > 1;) {
+            Case candidate = c;
+            candidate.lists.erase(candidate.lists.begin() + i);
+            if (!attempt(candidate))
+                ++i;
+        }
+        for (size_t l = 0; l < c.lists.size(); ++l) {
+            for (size_t chunk = c.lists[l].size() / 2; chunk > 0; chunk /= 2) {
+                for (size_t i = 0; i + chunk <= c.lists[l].size();) {
+                    Case candidate = c;
+                    candidate.lists[l].erase(i, chunk);
+                    if (!attempt(candidate))
+                        i += chunk;
+                }
+            }
+        }
+    }
+    return c;
+}
+
+void describe(std::ostream &os, const Action &action) {
+    if (typeid(action) == typeid(MoveForward))
+        os << "F";
+    else if (typeid(action) == typeid(MoveBackward))
+        os << "B";
+    else if (typeid(action) == typeid(RotateLeft))
+        os << "L";
+    else if (typeid(action) == typeid(RotateRight))
+        os << "R";
+    else if (typeid(action) == typeid(Hop))
+        os << "hop";
+    else if (typeid(action) == typeid(MoveUntilUnsafe))
+        os << "move_until_unsafe("
+           << static_cast<const MoveUntilUnsafe &>(action).limit() << ")";
+    else if (typeid(action) == typeid(Repeat)) {
+        const auto &r = static_cast<const Repeat &>(action);
+        os << "repeat(" << r.times() << ", ";
+        describe(os, *r.action());
+        os << ")";
+    }
+    else if (typeid(action) == typeid(Compose)) {
+        os << "compose(";
+        const char *separator = "";
+        for (const auto &part : static_cast<const Compose &>(action).actions()) {
+            os << separator;
+            describe(os, *part);
+            separator = ", ";
+        }
+        os << ")";
+    }
+}
+
+void report(const Engine &engine, const Case &c) {
+    with_range(engine.bounds, [&]<class Range>() {
+        Case landed = landed_in<Range>(c);
+        Trace expected = reference_with<Range>(landed);
+        Trace actual = engine.run(landed);
+        ptrdiff_t i = first_difference(engine, landed, expected);
+        size_t lists = landed.lists.size();
+        std::cout << "engine " << engine.name << " differs on case seed "
+                  << c.seed << "\nworld: ";
+        switch (c.kind) {
+            case WorldKind::RTREE:
+                std::cout << "rtree\n";
+                for (const auto &r : c.rectangles)
+                    std::cout << "  rectangle (" << r.x0 << ", " << r.y0
+                              << ") (" << r.x1 << ", " << r.y1 << ")\n";
+                for (const auto &polygon : c.polygons) {
+                    std::cout << "  polygon";
+                    for (auto [x, y] : polygon.vertices)
+                        std::cout << " (" << x << ", " << y << ")";
+                    std::cout << "\n";
+                }
+                break;
+            case WorldKind::INTERVAL:
+                std::cout << "interval\n";
+                for (const auto &span : c.spans)
+                    std::cout << "  span " << span.y << ": " << span.x0
+                              << " .. " << span.x1 << "\n";
+                break;
+            case WorldKind::NOISE:
+                std::cout << "noise, seed "
+                          << static_cast<uint32_t>(c.world.seed)
+                          << ", scale_log2 " << c.noise_scale_log2
+                          << ", threshold " << c.noise_threshold << "\n";
+                break;
+            case WorldKind::BLOOM:
+                std::cout << "bloom, " << c.bits_per_hazard
+                          << " bits per hazard\n";
+                for (auto [x, y] : c.cells)
+                    std::cout << "  cell (" << x << ", " << y << ")\n";
+                for (auto [x, y] : c.decoys)
+                    std::cout << "  decoy (" << x << ", " << y << ")\n";
+                break;
+            default:
+                std::cout << "seed " << c.world.seed
+                          << ", density " << c.world.density << ", clustering "
+                          << c.world.clustering << ", cluster_log2 "
+                          << c.world.cluster_log2 << ", corridor_spacing "
+                          << c.world.corridor_spacing << "\n";
+                break;
+        }
+        std::cout << "commands:\n";
+        for (const auto &[name, action] : landed.commands) {
+            std::cout << "  " << name << " = ";
+            describe(std::cout, *action);
+            std::cout << "\n";
+        }
+        for (const auto &[token, action] : landed.tokens) {
+            std::cout << "  " << token << " = ";
+            describe(std::cout, *action);
+            std::cout << "\n";
+        }
+        std::cout << "landed at " << landed.landings[i / lists]
+                  << "\nlists:\n";
+        for (size_t l = 0; l <= static_cast<size_t>(i) % lists; ++l)
+            std::cout << "  \"" << landed.lists[l] << "\"\n";
+        std::cout << "expected " << expected[i].shown << " ("
+                  << static_cast<int>(expected[i].reason) << "), got "
+                  << actual[i].shown << " ("
+                  << static_cast<int>(actual[i].reason) << ")\n";
+        return 0;
+    });
+}
+
+int main(int argc, char *argv[]) {
+    uint64_t cases = 10000;
+    double seconds = 0;
+    uint64_t seed = 1;
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    bool per_command = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string option = argv[i];
+        if (option == "--per-command") {
+            per_command = true;
+            continue;
+        }
+        if (i + 1 == argc) {
+            std::cerr << "missing value of " << option << "\n";
+            return 2;
+        }
+        std::string value = argv[++i];
+        if (option == "--cases")
+            cases = std::stoull(value);
+        else if (option == "--seconds")
+            seconds = std::stod(value);
+        else if (option == "--seed")
+            seed = std::stoull(value);
+        else if (option == "--threads")
+            threads = std::max(1, std::stoi(value));
+        else {
+            std::cerr << "unknown option " << option << "\n";
+            return 2;
+        }
+    }
+
+    using clock = std::chrono::steady_clock;
+    auto start = clock::now();
+    auto out_of_time = [&] {
+        std::chrono::duration<double> elapsed = clock::now() - start;
+        return seconds > 0 && elapsed.count() >= seconds;
+    };
+    std::atomic<uint64_t> next_case = 0;
+    std::atomic<uint64_t> commands_run = 0;
+    std::atomic<bool> failed = false;
+    std::mutex reporting;
+
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back([&] {
+            while (!failed && !out_of_time()) {
+                uint64_t i = next_case++;
+                if (cases != 0 && i >= cases)
+                    return;
+                Case c = make_case(seed + i);
+                if (per_command)
+                    c = split_commands(c);
+                uint64_t commands = 0;
+                for (const auto &list : c.lists)
+                    commands += list.size();
+                std::map<Bounds, Trace> references;
+                for (const Engine &engine : ENGINES) {
+                    if (!fails(engine, c, &references)) {
+                        commands_run += commands * c.landings.size();
+                        continue;
+                    }
+                    std::lock_guard lock(reporting);
+                    if (failed.exchange(true))
+                        return;
+                    report(engine, shrink(engine, c));
+                    return;
+                }
+            }
+        });
+    }
+    for (auto &worker : workers)
+        worker.join();
+
+    std::chrono::duration<double> elapsed = clock::now() - start;
+    std::cout << std::min(next_case.load(), cases == 0 ? UINT64_MAX : cases)
+              << " cases, " << commands_run << " commands compared in "
+              << elapsed.count() << " s on " << threads << " threads\n";
+    return failed ? 1 : 0;
+}